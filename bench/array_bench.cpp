@@ -0,0 +1,223 @@
+// 一个工作线程一个队列的数组布局下的伪共享：每个线程只访问自己的队列，
+// 理想情况下吞吐量随线程数线性增长。结果以JSON输出到stdout
+// g++ -std=c++17 -O2 -pthread -I. bench/array_bench.cpp -o array_bench
+// ./array_bench [key=value ...]
+//   backends=packed,queue,ring   packed为mutex+condition_variable+std::queue
+//                                 紧挨着排列、不做任何对齐的基线
+//   workers=1,2,4,8,16            线程数，也就是数组里队列的个数
+//   pinned=0,1                    1表示按线程编号绑定到CPU
+//   ops=1048576 batch=16          ops为每个线程的push次数，每push batch个再取出
+// 每个配置输出一个对象，mops为所有线程合计的每秒百万次push+pop
+
+#include "queue_ts.hpp"
+#include "ring_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Item {
+  long value = 0;
+};
+
+// 对齐之前的Queue布局：容器、锁和条件变量依次排列，相邻实例共享缓存行
+struct PackedQueue {
+  std::queue<std::unique_ptr<Item>> queue;
+  std::mutex lock;
+  std::condition_variable cv;
+  size_t waiters = 0;
+
+  void push(Item item) {
+    auto node = std::make_unique<Item>(item);
+    std::lock_guard<std::mutex> guard(lock);
+    queue.push(std::move(node));
+    if (waiters > 0) {
+      cv.notify_one();
+    }
+  }
+
+  std::unique_ptr<Item> pop_try() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (queue.empty()) {
+      return nullptr;
+    }
+    std::unique_ptr<Item> value = std::move(queue.front());
+    queue.pop();
+    return value;
+  }
+};
+
+struct Config {
+  std::string backend;
+  int workers = 1;
+  bool pinned = false;
+  long ops = 1 << 20;
+  long batch = 16;
+};
+
+void pin(int index) {
+#ifdef __linux__
+  unsigned cpus = std::thread::hardware_concurrency();
+  if (cpus == 0) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(static_cast<unsigned>(index) % cpus, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)index;
+#endif
+}
+
+template <class Q> double run(const Config &config) {
+  // 与部署时一样，一次分配一整个数组
+  std::unique_ptr<Q[]> queues(new Q[config.workers]);
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::atomic<long> sink{0};
+  std::vector<std::thread> workers;
+  for (int w = 0; w < config.workers; ++w) {
+    workers.emplace_back([&, w]() {
+      if (config.pinned) {
+        pin(w);
+      }
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      Q &queue = queues[w];
+      long local = 0;
+      for (long i = 0; i < config.ops; i += config.batch) {
+        for (long j = 0; j < config.batch; ++j) {
+          queue.push(Item{i + j});
+        }
+        for (long j = 0; j < config.batch; ++j) {
+          local += queue.pop_try()->value;
+        }
+      }
+      sink.fetch_add(local, std::memory_order_relaxed);
+    });
+  }
+  while (ready.load() < config.workers) {
+    std::this_thread::yield();
+  }
+  auto start = Clock::now();
+  go.store(true, std::memory_order_release);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool run_config(const Config &config, double &seconds) {
+  if (config.backend == "packed") {
+    seconds = run<PackedQueue>(config);
+  } else if (config.backend == "queue") {
+    seconds = run<ThreadSafe::Queue<Item, std::unique_ptr>>(config);
+  } else if (config.backend == "ring") {
+    seconds = run<ThreadSafe::RingQueue<Item, std::unique_ptr, 1024>>(config);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::vector<std::string> split(const std::string &text) {
+  std::vector<std::string> parts;
+  size_t begin = 0;
+  for (;;) {
+    size_t end = text.find(',', begin);
+    parts.push_back(text.substr(begin, end - begin));
+    if (end == std::string::npos) {
+      return parts;
+    }
+    begin = end + 1;
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> backends = {"packed", "queue", "ring"};
+  std::vector<std::string> workers = {"1", "2", "4", "8", "16"};
+  std::vector<std::string> pinned = {"0", "1"};
+  Config base;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (eq == std::string::npos) {
+      std::fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+    std::string key = arg.substr(0, eq);
+    std::string value = arg.substr(eq + 1);
+    if (key == "backends") {
+      backends = split(value);
+    } else if (key == "workers") {
+      workers = split(value);
+    } else if (key == "pinned") {
+      pinned = split(value);
+    } else if (key == "ops") {
+      base.ops = std::atol(value.c_str());
+    } else if (key == "batch") {
+      base.batch = std::atol(value.c_str());
+    } else {
+      std::fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (base.batch <= 0 || base.batch > 1024) {
+    std::fprintf(stderr, "batch must be in [1, 1024]\n");
+    return 1;
+  }
+  base.ops = base.ops / base.batch * base.batch;
+
+  std::printf("{\"hardware_concurrency\": %u, \"results\": [",
+              std::thread::hardware_concurrency());
+  bool first = true;
+  for (const std::string &backend : backends) {
+    for (const std::string &count : workers) {
+      for (const std::string &pin : pinned) {
+        Config config = base;
+        config.backend = backend;
+        config.workers = std::atoi(count.c_str());
+        config.pinned = pin == "1";
+        if (config.workers <= 0) {
+          continue;
+        }
+        double seconds = 0;
+        if (!run_config(config, seconds)) {
+          continue;
+        }
+        double ops = 2.0 * static_cast<double>(config.ops) * config.workers;
+        std::printf("%s\n  {\"backend\": \"%s\", \"workers\": %d, "
+                    "\"pinned\": %s, \"ops_per_worker\": %ld, "
+                    "\"batch\": %ld, \"seconds\": %.6f, \"mops\": %.3f}",
+                    first ? "" : ",", backend.c_str(), config.workers,
+                    config.pinned ? "true" : "false", config.ops, config.batch,
+                    seconds, ops / seconds / 1e6);
+        std::fflush(stdout);
+        first = false;
+      }
+    }
+  }
+  std::printf("\n]}\n");
+  return 0;
+}
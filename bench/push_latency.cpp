@@ -0,0 +1,120 @@
+// 生产者push延迟(p50/p99/p999)，用于对比push路径的改动
+// g++ -std=c++17 -O2 -pthread -I. bench/push_latency.cpp -o push_latency
+// ./push_latency [producers] [consumers] [pushes_per_producer] [path]
+//   path=old   锁内分配、每次push都在锁内notify_one的旧路径(LegacyQueue)
+//   path=new   ThreadSafe::Queue：锁外分配，有等待者时才在解锁后notify
+//   path=both  默认，同一个进程里先后各跑一遍
+
+#include "queue_ts.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+struct Message {
+  char payload[64];
+};
+
+// 改动之前的Queue<T, std::unique_ptr>::push：make_unique和notify_one都在
+// 临界区内，没有等待者时也notify
+class LegacyQueue {
+public:
+  void push(Message &&value) {
+    std::lock_guard<std::mutex> lock(_lock);
+    _queue.push(std::make_unique<Message>(std::move(value)));
+    _cv.notify_one();
+  }
+
+  std::unique_ptr<Message> pop_for(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(_lock);
+    if (!_cv.wait_for(lock, timeout, [this]() { return !_queue.empty(); })) {
+      return nullptr;
+    }
+    std::unique_ptr<Message> value = std::move(_queue.front());
+    _queue.pop();
+    return value;
+  }
+
+private:
+  std::mutex _lock;
+  std::condition_variable _cv;
+  std::queue<std::unique_ptr<Message>> _queue;
+};
+
+template <class Q>
+void run(const char *path, int producers, int consumers, int pushes) {
+  Q queue;
+  std::vector<std::vector<long>> latencies(producers);
+  std::atomic<int> finished{0};
+  std::vector<std::thread> threads;
+
+  auto begin = std::chrono::steady_clock::now();
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p]() {
+      std::vector<long> &samples = latencies[p];
+      samples.reserve(pushes);
+      for (int i = 0; i < pushes; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        queue.push(Message{});
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        samples.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count());
+      }
+      finished.fetch_add(1);
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&]() {
+      while (queue.pop_for(std::chrono::milliseconds(20)) ||
+             finished.load() < producers) {
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  auto total = std::chrono::steady_clock::now() - begin;
+
+  std::vector<long> all;
+  for (const std::vector<long> &samples : latencies) {
+    all.insert(all.end(), samples.begin(), samples.end());
+  }
+  std::sort(all.begin(), all.end());
+  std::printf("path=%s producers=%d consumers=%d p50=%ldns p99=%ldns "
+              "p999=%ldns total=%lldms\n",
+              path, producers, consumers, all[all.size() / 2],
+              all[all.size() * 99 / 100], all[all.size() * 999 / 1000],
+              static_cast<long long>(
+                  std::chrono::duration_cast<std::chrono::milliseconds>(total)
+                      .count()));
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int producers = argc > 1 ? std::atoi(argv[1]) : 4;
+  int consumers = argc > 2 ? std::atoi(argv[2]) : 4;
+  int pushes = argc > 3 ? std::atoi(argv[3]) : 200000;
+  const char *path = argc > 4 ? argv[4] : "both";
+
+  bool old_path = std::strcmp(path, "new") != 0;
+  bool new_path = std::strcmp(path, "old") != 0;
+  if (old_path) {
+    run<LegacyQueue>("old", producers, consumers, pushes);
+  }
+  if (new_path) {
+    run<ThreadSafe::Queue<Message, std::unique_ptr>>("new", producers,
+                                                     consumers, pushes);
+  }
+  return 0;
+}
@@ -0,0 +1,384 @@
+// 各队列后端在竞争下的吞吐量与每次操作的延迟直方图，结果以JSON输出到stdout
+// g++ -std=c++17 -O2 -pthread -I. bench/queue_bench.cpp -o queue_bench
+// ./queue_bench [key=value ...]
+//   backends=queue,ring,sharded,spsc,segmented
+//                                      queue为mutex+std::queue基线
+//   threads=1x1,4x4,64x64              生产者x消费者
+//   payloads=8,64,1024                 元素字节数
+//   modes=unique,shared,inline
+//   arrivals=steady,burst              steady连续push；burst每burst个暂停pause_us
+//   pinned=0,1                         1表示按线程编号绑定到CPU
+//   ops=262144 burst=256 pause_us=100  ops为每组配置的总元素数
+// 每个配置输出一个对象，push_ns/pop_ns的hist[i]是耗时落在[2^i, 2^(i+1))纳秒的次数
+
+#include "queue_ts.hpp"
+#include "ring_ts.hpp"
+#include "segmented_ts.hpp"
+#include "sharded_ts.hpp"
+#include "spsc_ts.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+template <size_t Size> struct Payload {
+  char data[Size] = {};
+};
+
+struct Histogram {
+  std::array<uint64_t, 64> buckets{};
+  uint64_t count = 0;
+  uint64_t max = 0;
+
+  void add(uint64_t ns) {
+    size_t bucket = 0;
+    for (uint64_t v = ns; v > 1; v >>= 1) {
+      ++bucket;
+    }
+    ++buckets[bucket];
+    ++count;
+    max = ns > max ? ns : max;
+  }
+
+  void merge(const Histogram &other) {
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    max = other.max > max ? other.max : max;
+  }
+
+  // 返回分位点所在桶的上界
+  uint64_t percentile(double p) const {
+    uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      seen += buckets[i];
+      if (seen > rank) {
+        return (uint64_t(2) << i) - 1;
+      }
+    }
+    return max;
+  }
+};
+
+struct Config {
+  std::string backend;
+  std::string mode;
+  int producers = 1;
+  int consumers = 1;
+  size_t payload = 64;
+  bool burst = false;
+  bool pinned = false;
+  long ops = 1 << 18;
+  long burst_size = 256;
+  long pause_us = 100;
+};
+
+struct Result {
+  double seconds = 0;
+  Histogram push;
+  Histogram pop;
+};
+
+void pin(int index) {
+#ifdef __linux__
+  unsigned cpus = std::thread::hardware_concurrency();
+  if (cpus == 0) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(static_cast<unsigned>(index) % cpus, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)index;
+#endif
+}
+
+uint64_t since(Clock::time_point start) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           start)
+          .count());
+}
+
+template <class Item, class Q> Result run(Q &queue, const Config &config) {
+  long per_producer = config.ops / config.producers;
+  long total = per_producer * config.producers;
+  int threads = config.producers + config.consumers;
+
+  std::vector<Histogram> push(config.producers);
+  std::vector<Histogram> pop(config.consumers);
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::atomic<long> claimed{0};
+  std::atomic<long> sink{0};
+  std::vector<std::thread> workers;
+
+  auto start_gate = [&](int index) {
+    if (config.pinned) {
+      pin(index);
+    }
+    ready.fetch_add(1);
+    while (!go.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  };
+
+  for (int p = 0; p < config.producers; ++p) {
+    workers.emplace_back([&, p]() {
+      start_gate(p);
+      Histogram &hist = push[p];
+      for (long i = 0; i < per_producer; ++i) {
+        if (config.burst && i != 0 && i % config.burst_size == 0) {
+          std::this_thread::sleep_for(
+              std::chrono::microseconds(config.pause_us));
+        }
+        auto start = Clock::now();
+        queue.push(Item());
+        hist.add(since(start));
+      }
+    });
+  }
+  for (int c = 0; c < config.consumers; ++c) {
+    workers.emplace_back([&, c]() {
+      start_gate(config.producers + c);
+      Histogram &hist = pop[c];
+      long local = 0;
+      // 先领取名额再阻塞，保证所有消费者都能退出
+      while (claimed.fetch_add(1, std::memory_order_relaxed) < total) {
+        auto start = Clock::now();
+        auto value = queue.pop_must();
+        hist.add(since(start));
+        local += value->data[0];
+      }
+      sink.fetch_add(local, std::memory_order_relaxed);
+    });
+  }
+
+  while (ready.load() < threads) {
+    std::this_thread::yield();
+  }
+  auto start = Clock::now();
+  go.store(true, std::memory_order_release);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  Result result;
+  result.seconds = static_cast<double>(since(start)) / 1e9;
+  for (const Histogram &hist : push) {
+    result.push.merge(hist);
+  }
+  for (const Histogram &hist : pop) {
+    result.pop.merge(hist);
+  }
+  return result;
+}
+
+template <template <typename> class SmartPtr, size_t Size>
+bool run_backend(const Config &config, Result &result) {
+  using Item = Payload<Size>;
+  constexpr size_t ring_capacity = 1024;
+  if (config.backend == "queue") {
+    ThreadSafe::Queue<Item, SmartPtr> queue;
+    result = run<Item>(queue, config);
+  } else if (config.backend == "ring") {
+    ThreadSafe::RingQueue<Item, SmartPtr, ring_capacity> queue;
+    result = run<Item>(queue, config);
+  } else if (config.backend == "sharded") {
+    ThreadSafe::ShardedQueue<Item, SmartPtr> queue;
+    result = run<Item>(queue, config);
+  } else if (config.backend == "segmented") {
+    ThreadSafe::SegmentedQueue<Item, SmartPtr> queue;
+    result = run<Item>(queue, config);
+  } else if (config.backend == "spsc") {
+    if (config.producers != 1 || config.consumers != 1) {
+      return false;
+    }
+    ThreadSafe::SpscQueue<Item, SmartPtr, ring_capacity> queue;
+    result = run<Item>(queue, config);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+template <template <typename> class SmartPtr>
+bool run_payload(const Config &config, Result &result) {
+  switch (config.payload) {
+  case 8:
+    return run_backend<SmartPtr, 8>(config, result);
+  case 64:
+    return run_backend<SmartPtr, 64>(config, result);
+  case 256:
+    return run_backend<SmartPtr, 256>(config, result);
+  case 1024:
+    return run_backend<SmartPtr, 1024>(config, result);
+  default:
+    return false;
+  }
+}
+
+bool run_config(const Config &config, Result &result) {
+  if (config.mode == "unique") {
+    return run_payload<std::unique_ptr>(config, result);
+  }
+  if (config.mode == "shared") {
+    return run_payload<std::shared_ptr>(config, result);
+  }
+  if (config.mode == "inline") {
+    return run_payload<ThreadSafe::Inline>(config, result);
+  }
+  return false;
+}
+
+std::vector<std::string> split(const std::string &text) {
+  std::vector<std::string> parts;
+  size_t begin = 0;
+  for (;;) {
+    size_t end = text.find(',', begin);
+    parts.push_back(text.substr(begin, end - begin));
+    if (end == std::string::npos) {
+      return parts;
+    }
+    begin = end + 1;
+  }
+}
+
+void print_histogram(const char *name, const Histogram &hist) {
+  size_t last = 0;
+  for (size_t i = 0; i < hist.buckets.size(); ++i) {
+    if (hist.buckets[i] != 0) {
+      last = i;
+    }
+  }
+  std::printf("\"%s\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, "
+              "\"max\": %llu, \"hist\": [",
+              name, (unsigned long long)hist.percentile(0.5),
+              (unsigned long long)hist.percentile(0.99),
+              (unsigned long long)hist.percentile(0.999),
+              (unsigned long long)hist.max);
+  for (size_t i = 0; i <= last; ++i) {
+    std::printf(i == 0 ? "%llu" : ", %llu",
+                (unsigned long long)hist.buckets[i]);
+  }
+  std::printf("]}");
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> backends = {"queue", "ring", "sharded", "spsc",
+                                       "segmented"};
+  std::vector<std::string> threads = {"1x1",   "2x2",   "4x4",  "8x8",
+                                      "16x16", "32x32", "64x64"};
+  std::vector<std::string> payloads = {"8", "64", "1024"};
+  std::vector<std::string> modes = {"unique", "shared"};
+  std::vector<std::string> arrivals = {"steady", "burst"};
+  std::vector<std::string> pinned = {"0", "1"};
+  Config base;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (eq == std::string::npos) {
+      std::fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+    std::string key = arg.substr(0, eq);
+    std::string value = arg.substr(eq + 1);
+    if (key == "backends") {
+      backends = split(value);
+    } else if (key == "threads") {
+      threads = split(value);
+    } else if (key == "payloads") {
+      payloads = split(value);
+    } else if (key == "modes") {
+      modes = split(value);
+    } else if (key == "arrivals") {
+      arrivals = split(value);
+    } else if (key == "pinned") {
+      pinned = split(value);
+    } else if (key == "ops") {
+      base.ops = std::atol(value.c_str());
+    } else if (key == "burst") {
+      base.burst_size = std::atol(value.c_str());
+    } else if (key == "pause_us") {
+      base.pause_us = std::atol(value.c_str());
+    } else {
+      std::fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::printf("{\"hardware_concurrency\": %u, \"results\": [",
+              std::thread::hardware_concurrency());
+  bool first = true;
+  for (const std::string &backend : backends) {
+    for (const std::string &shape : threads) {
+      for (const std::string &payload : payloads) {
+        for (const std::string &mode : modes) {
+          for (const std::string &arrival : arrivals) {
+            for (const std::string &pin : pinned) {
+              Config config = base;
+              config.backend = backend;
+              config.mode = mode;
+              config.producers = std::atoi(shape.c_str());
+              size_t x = shape.find('x');
+              config.consumers =
+                  x == std::string::npos ? config.producers
+                                         : std::atoi(shape.c_str() + x + 1);
+              config.payload = std::strtoul(payload.c_str(), nullptr, 10);
+              config.burst = arrival == "burst";
+              config.pinned = pin == "1";
+              if (config.producers <= 0 || config.consumers <= 0 ||
+                  config.ops < config.producers) {
+                continue;
+              }
+              Result result;
+              if (!run_config(config, result)) {
+                continue;
+              }
+              long ops = config.ops / config.producers * config.producers;
+              std::printf("%s\n  {\"backend\": \"%s\", \"mode\": \"%s\", "
+                          "\"payload\": %zu, \"producers\": %d, "
+                          "\"consumers\": %d, \"arrival\": \"%s\", "
+                          "\"pinned\": %s, \"ops\": %ld, \"seconds\": %.6f, "
+                          "\"mops\": %.3f, ",
+                          first ? "" : ",", backend.c_str(), mode.c_str(),
+                          config.payload, config.producers, config.consumers,
+                          arrival.c_str(), config.pinned ? "true" : "false",
+                          ops, result.seconds,
+                          static_cast<double>(ops) / result.seconds / 1e6);
+              print_histogram("push_ns", result.push);
+              std::printf(", ");
+              print_histogram("pop_ns", result.pop);
+              std::printf("}");
+              std::fflush(stdout);
+              first = false;
+            }
+          }
+        }
+      }
+    }
+  }
+  std::printf("\n]}\n");
+  return 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// C++20协程支持：编译器和标准库都支持协程时定义THREAD_SAFE_COROUTINES，
+// Queue随之提供co_pop()；否则只保留不依赖<coroutine>的等待节点。
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define THREAD_SAFE_COROUTINES 1
+#endif
+#endif
+
+namespace ThreadSafe {
+namespace detail {
+
+// 挂在Queue上的协程等待节点(侵入式单链表)。push在锁内把元素放进value，
+// 摘下节点，解锁之后再调用wake，wake之后节点可能已经被销毁。
+template <class Value> struct CoWaiter {
+  CoWaiter *next = nullptr;
+  Value value{};
+  void (*wake)(CoWaiter *) = nullptr;
+};
+} // namespace detail
+
+#ifdef THREAD_SAFE_COROUTINES
+// 在push / close的调用线程上直接恢复协程
+struct InlineExecutor {
+  void operator()(std::coroutine_handle<> handle) const { handle.resume(); }
+};
+#endif
+}; // namespace ThreadSafe
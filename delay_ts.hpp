@@ -0,0 +1,345 @@
+#pragma once
+
+#include "detail_ts.hpp"
+#include "wheel_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+namespace ThreadSafe {
+
+// 元素在各自的到期时间之后才能取出的队列。到期时间放进分层时间轮
+// (wheel_ts.hpp)，push为O(1)；pop只睡到最早的到期时间，醒来后推进时间轮，
+// 不扫描整个容器。精度为构造时给定的tick：到期时间向上取整到tick，
+// 元素不会早于到期时间取出，最多晚一个tick。
+// 同一时刻只有一个消费者(leader)定时等待最早的到期时间，其余消费者不定时睡眠，
+// 取走元素的leader再唤醒下一个，到期时不会惊醒所有消费者。
+template <typename T, template <typename> class SmartPtr> class DelayQueue {
+  static_assert(detail::is_storage_v<T, SmartPtr>,
+                "SmartPtr must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit DelayQueue(clock::duration tick = std::chrono::milliseconds(1));
+  ~DelayQueue();
+
+  DelayQueue(const DelayQueue &) = delete;
+  DelayQueue &operator=(const DelayQueue &) = delete;
+
+  // close()之后返回false
+  bool push(const T &value, clock::time_point due);
+  bool push(T &&value, clock::time_point due);
+  template <class Rep, class Period>
+  bool push(const T &value, const std::chrono::duration<Rep, Period> &delay);
+  template <class Rep, class Period>
+  bool push(T &&value, const std::chrono::duration<Rep, Period> &delay);
+
+  template <class... Args> bool emplace(clock::time_point due, Args &&...args);
+
+  // 以下只返回已经到期的元素
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // close()之后push失败；未到期的元素仍然按时取出，全部取完后阻塞的pop返回空值
+  void close();
+  bool closed() const;
+  // 取走全部元素(包括未到期的)，按到期顺序之外的任意顺序写入out，返回个数
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  size_t size() const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+private:
+  struct Node {
+    template <class... Args>
+    explicit Node(uint64_t due, Args &&...args)
+        : tick(due), value(std::forward<Args>(args)...) {}
+
+    Node *next = nullptr;
+    uint64_t tick;
+    detail::stored_t<T, SmartPtr> value;
+  };
+
+  uint64_t tick_of(clock::time_point time, bool round_up) const;
+  clock::time_point time_of(uint64_t tick) const;
+
+  SmartPtr<T> take(std::unique_lock<std::mutex> &lock);
+  template <class Clock, class Duration>
+  SmartPtr<T> take_until(std::unique_lock<std::mutex> &lock,
+                         const std::chrono::time_point<Clock, Duration> *limit);
+
+  clock::time_point _base;
+  clock::duration _tick;
+  mutable std::mutex _lock;
+  std::condition_variable _cv;
+  detail::TimingWheel<Node> _wheel;
+  // 正在定时等待最早到期时间的消费者(指向它栈上的标记)，没有时为nullptr
+  const void *_leader = nullptr;
+  std::atomic<size_t> _count{0};
+  std::atomic<bool> _closed{false};
+};
+
+template <typename T, template <typename> class SmartPtr>
+DelayQueue<T, SmartPtr>::DelayQueue(clock::duration tick)
+    : _base(clock::now()),
+      _tick(tick.count() > 0 ? tick : clock::duration(1)) {}
+
+template <typename T, template <typename> class SmartPtr>
+DelayQueue<T, SmartPtr>::~DelayQueue() {
+  Node *node = _wheel.release();
+  while (node != nullptr) {
+    Node *next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
+template <typename T, template <typename> class SmartPtr>
+uint64_t DelayQueue<T, SmartPtr>::tick_of(clock::time_point time,
+                                          bool round_up) const {
+  if (time <= _base) {
+    return 0;
+  }
+  auto elapsed = (time - _base).count();
+  auto tick = _tick.count();
+  return static_cast<uint64_t>(elapsed / tick +
+                               (round_up && elapsed % tick != 0 ? 1 : 0));
+}
+
+template <typename T, template <typename> class SmartPtr>
+auto DelayQueue<T, SmartPtr>::time_of(uint64_t tick) const
+    -> clock::time_point {
+  return _base + _tick * static_cast<clock::rep>(tick);
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool DelayQueue<T, SmartPtr>::push(const T &value, clock::time_point due) {
+  return emplace(due, value);
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool DelayQueue<T, SmartPtr>::push(T &&value, clock::time_point due) {
+  return emplace(due, std::move(value));
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class Rep, class Period>
+bool DelayQueue<T, SmartPtr>::push(
+    const T &value, const std::chrono::duration<Rep, Period> &delay) {
+  return emplace(clock::now() + delay, value);
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class Rep, class Period>
+bool DelayQueue<T, SmartPtr>::push(
+    T &&value, const std::chrono::duration<Rep, Period> &delay) {
+  return emplace(clock::now() + delay, std::move(value));
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class... Args>
+bool DelayQueue<T, SmartPtr>::emplace(clock::time_point due, Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  // 节点和元素都在加锁之前构造
+  Node *node;
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    node = new Node(tick_of(due, true), std::forward<Args>(args)...);
+  } else {
+    node = new Node(tick_of(due, true), detail::make_smart<T, SmartPtr>(
+                                            std::forward<Args>(args)...));
+  }
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    if (closed()) {
+      delete node;
+      return false;
+    }
+    // 新元素比原来最早的到期时间还早时，正在定时等待的leader需要提前醒来
+    uint64_t earliest = _wheel.next();
+    _wheel.insert(node);
+    _count.store(_count.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+    wake = node->tick < earliest;
+    if (wake) {
+      _leader = nullptr;
+    }
+  }
+  if (wake) {
+    _cv.notify_one();
+  }
+  return true;
+}
+
+// 持锁调用，ready链表非空：取出一个，还有到期元素时把leader交给下一个消费者
+template <typename T, template <typename> class SmartPtr>
+SmartPtr<T>
+DelayQueue<T, SmartPtr>::take(std::unique_lock<std::mutex> &lock) {
+  Node *node = _wheel.take();
+  _count.store(_count.load(std::memory_order_relaxed) - 1,
+               std::memory_order_relaxed);
+  bool wake =
+      _leader == nullptr && (_wheel.next() != _wheel.never || closed());
+  lock.unlock();
+  if (wake) {
+    _cv.notify_one();
+  }
+  SmartPtr<T> value(std::move(node->value));
+  delete node;
+  return value;
+}
+
+// limit为空表示不限时；超时或关闭且取空时返回空值
+template <typename T, template <typename> class SmartPtr>
+template <class Clock, class Duration>
+SmartPtr<T> DelayQueue<T, SmartPtr>::take_until(
+    std::unique_lock<std::mutex> &lock,
+    const std::chrono::time_point<Clock, Duration> *limit) {
+  for (;;) {
+    _wheel.advance(tick_of(clock::now(), false));
+    if (_wheel.ready()) {
+      return take(lock);
+    }
+    uint64_t next = _wheel.next();
+    if (next == _wheel.never && closed()) {
+      // 让其它等待的消费者也看到关闭
+      lock.unlock();
+      _cv.notify_all();
+      return {};
+    }
+    if (limit != nullptr && Clock::now() >= *limit) {
+      // 超时的可能是刚卸任的leader，交给下一个消费者定时等待
+      bool wake = _leader == nullptr && next != _wheel.never;
+      lock.unlock();
+      if (wake) {
+        _cv.notify_one();
+      }
+      return {};
+    }
+    if (_leader != nullptr || next == _wheel.never) {
+      if (limit == nullptr) {
+        _cv.wait(lock);
+      } else {
+        _cv.wait_until(lock, *limit);
+      }
+      continue;
+    }
+    char token;
+    _leader = &token;
+    clock::time_point due = time_of(next);
+    if (limit == nullptr) {
+      _cv.wait_until(lock, due);
+    } else {
+      // limit可能是其它时钟，换算成steady_clock的时间点
+      auto remaining = *limit - Clock::now();
+      clock::time_point deadline =
+          clock::now() +
+          std::chrono::duration_cast<clock::duration>(remaining);
+      _cv.wait_until(lock, due < deadline ? due : deadline);
+    }
+    // 期间有更早的元素时push已经撤掉了这个leader，不要覆盖新的leader
+    if (_leader == &token) {
+      _leader = nullptr;
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr>
+SmartPtr<T> DelayQueue<T, SmartPtr>::pop_must() {
+  std::unique_lock<std::mutex> lock(_lock);
+  return take_until<clock, clock::duration>(lock, nullptr);
+}
+
+template <typename T, template <typename> class SmartPtr>
+SmartPtr<T> DelayQueue<T, SmartPtr>::pop_try() {
+  std::unique_lock<std::mutex> lock(_lock);
+  _wheel.advance(tick_of(clock::now(), false));
+  if (!_wheel.ready()) {
+    return {};
+  }
+  return take(lock);
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class Rep, class Period>
+SmartPtr<T> DelayQueue<T, SmartPtr>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class Clock, class Duration>
+SmartPtr<T> DelayQueue<T, SmartPtr>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  std::unique_lock<std::mutex> lock(_lock);
+  return take_until(lock, &timeout_time);
+}
+
+template <typename T, template <typename> class SmartPtr>
+void DelayQueue<T, SmartPtr>::close() {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _closed.store(true, std::memory_order_relaxed);
+  }
+  _cv.notify_all();
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool DelayQueue<T, SmartPtr>::closed() const {
+  return _closed.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class OutputIt>
+size_t DelayQueue<T, SmartPtr>::drain_into(OutputIt out) {
+  Node *node;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    node = _wheel.release();
+    _count.store(0, std::memory_order_relaxed);
+  }
+  _cv.notify_all();
+  size_t count = 0;
+  while (node != nullptr) {
+    Node *next = node->next;
+    *out = std::move(node->value);
+    ++out;
+    delete node;
+    node = next;
+    ++count;
+  }
+  return count;
+}
+
+template <typename T, template <typename> class SmartPtr>
+size_t DelayQueue<T, SmartPtr>::size() const {
+  std::lock_guard<std::mutex> lock(_lock);
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr>
+size_t DelayQueue<T, SmartPtr>::size_approx() const {
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool DelayQueue<T, SmartPtr>::empty_approx() const {
+  return size_approx() == 0;
+}
+}; // namespace ThreadSafe
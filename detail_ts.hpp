@@ -0,0 +1,249 @@
+#pragma once
+
+#include "pool_ts.hpp"
+#include "wait_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ThreadSafe {
+
+template <typename T> using Inline = std::optional<T>;
+
+namespace detail {
+// 隔开不同线程各自写入的状态所用的对齐。
+// std::hardware_destructive_interference_size在GCC下会随-mtune变化并给出
+// -Winterference-size警告，不适合放进头文件里的类布局，所以默认取x86-64和
+// 大多数ARM64的64，可以用-DTHREAD_SAFE_CACHE_LINE=128之类覆盖
+#ifdef THREAD_SAFE_CACHE_LINE
+inline constexpr size_t cache_line = THREAD_SAFE_CACHE_LINE;
+#else
+inline constexpr size_t cache_line = 64;
+#endif
+
+template <typename T, template <typename> class SmartPtr>
+inline constexpr bool is_inline_v =
+    std::is_same_v<SmartPtr<T>, std::optional<T>>;
+
+template <typename T, template <typename> class SmartPtr>
+inline constexpr bool is_storage_v =
+    std::is_same_v<SmartPtr<T>, std::unique_ptr<T>> ||
+    std::is_same_v<SmartPtr<T>, std::shared_ptr<T>> ||
+    std::is_same_v<SmartPtr<T>, PoolUnique<T>> ||
+    std::is_same_v<SmartPtr<T>, PoolShared<T>> || is_inline_v<T, SmartPtr>;
+
+template <typename T, template <typename> class SmartPtr>
+using stored_t =
+    std::conditional_t<is_inline_v<T, SmartPtr>, T, SmartPtr<T>>;
+
+template <typename T, template <typename> class SmartPtr, class... Args>
+SmartPtr<T> make_smart(Args &&...args) {
+  if constexpr (std::is_same_v<SmartPtr<T>, std::unique_ptr<T>>) {
+    return std::make_unique<T>(std::forward<Args>(args)...);
+  } else if constexpr (std::is_same_v<SmartPtr<T>, std::shared_ptr<T>>) {
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  } else if constexpr (std::is_same_v<SmartPtr<T>, PoolUnique<T>>) {
+    return make_pool_unique<T>(std::forward<Args>(args)...);
+  } else if constexpr (std::is_same_v<SmartPtr<T>, PoolShared<T>>) {
+    return make_pool_shared<T>(std::forward<Args>(args)...);
+  } else {
+    return SmartPtr<T>(std::in_place, std::forward<Args>(args)...);
+  }
+}
+
+// 最低/最高的置位位的编号，value不能为0
+inline size_t lowest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<size_t>(__builtin_ctzll(value));
+#else
+  size_t bit = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+inline size_t highest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - static_cast<size_t>(__builtin_clzll(value));
+#else
+  size_t bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+// Queue的Cmp位置上可以放的后端标签(Ring<N>、Segmented<B>)，
+// 由定义标签的头文件特化为true
+template <class Cmp> struct is_backend_tag : std::false_type {};
+
+template <class Cmp>
+inline constexpr bool is_backend_tag_v = is_backend_tag<Cmp>::value;
+
+// 按模板参数不需要的成员换成的空类型
+struct Empty {};
+
+// 每个线程第一次调用时领取的编号，用于选择本线程的分片/计数槽
+inline size_t thread_index() {
+  static std::atomic<size_t> next{0};
+  thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+// 非对称屏障：heavy_barrier()与另一线程的light_barrier()配对，
+// 效果等同于两边各执行一次seq_cst fence。Linux上heavy_barrier()用
+// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED)让本进程所有正在运行的线程
+// 执行一次完整屏障，light_barrier()因此只需阻止编译器重排；
+// 系统调用不可用时两边都退回seq_cst fence
+#if defined(__linux__) && defined(__NR_membarrier)
+inline bool membarrier_register() {
+  return syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED,
+                 0, 0) == 0;
+}
+
+inline bool membarrier_ready() {
+  static const bool ready = membarrier_register();
+  return ready;
+}
+
+inline void light_barrier() {
+  if (membarrier_ready()) {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  } else {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+inline void heavy_barrier() {
+  if (!membarrier_ready()) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return;
+  }
+  // fork出的子进程没有继承注册，第一次失败时重新注册
+  if (syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) != 0 &&
+      (!membarrier_register() ||
+       syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) != 0)) {
+    std::abort();
+  }
+}
+#else
+inline void light_barrier() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void heavy_barrier() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+#endif
+
+// 无锁结构的阻塞路径：只有真正需要睡眠的线程才会碰到mutex/condition_variable。
+// 睡眠方登记_waiters后执行heavy_barrier()再检查条件；通知方在发布状态后
+// 只有light_barrier()和一次relaxed load，没有等待者时不碰任何共享写入。
+// Wait::parks为false时从不睡眠，notify_*为空。睡眠之前先按Wait策略自旋。
+template <class Wait = Block> class Parking {
+public:
+  template <class Ready> void wait(Ready ready);
+
+  template <class Ready, class Rep, class Period>
+  bool wait_for(Ready ready, const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Ready, class Clock, class Duration>
+  bool wait_until(Ready ready,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  void notify_one();
+  void notify_all();
+
+private:
+  bool has_waiters();
+
+  Wait _wait;
+  std::mutex _lock;
+  std::condition_variable _cv;
+  std::atomic<size_t> _waiters{0};
+};
+
+template <class Wait>
+template <class Ready>
+void Parking<Wait>::wait(Ready ready) {
+  if (ready() || _wait.spin(ready, []() { return false; })) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(_lock);
+  _waiters.fetch_add(1, std::memory_order_relaxed);
+  heavy_barrier();
+  _cv.wait(lock, ready);
+  _waiters.fetch_sub(1);
+}
+
+template <class Wait>
+template <class Ready, class Rep, class Period>
+bool Parking<Wait>::wait_for(
+    Ready ready, const std::chrono::duration<Rep, Period> &timeout) {
+  return wait_until(ready, std::chrono::steady_clock::now() + timeout);
+}
+
+template <class Wait>
+template <class Ready, class Clock, class Duration>
+bool Parking<Wait>::wait_until(
+    Ready ready, const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  if (ready() ||
+      _wait.spin(ready, [&]() { return Clock::now() >= timeout_time; })) {
+    return true;
+  }
+  if constexpr (!parks_v<Wait>) {
+    return ready();
+  }
+  std::unique_lock<std::mutex> lock(_lock);
+  _waiters.fetch_add(1, std::memory_order_relaxed);
+  heavy_barrier();
+  bool ok = _cv.wait_until(lock, timeout_time, ready);
+  _waiters.fetch_sub(1);
+  return ok;
+}
+
+template <class Wait> bool Parking<Wait>::has_waiters() {
+  if constexpr (!parks_v<Wait>) {
+    return false;
+  }
+  light_barrier();
+  if (_waiters.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  // 等待者要么还没检查条件(会看到新状态)，要么已经在_cv上睡眠
+  std::lock_guard<std::mutex> lock(_lock);
+  return true;
+}
+
+template <class Wait> void Parking<Wait>::notify_one() {
+  if (has_waiters()) {
+    _cv.notify_one();
+  }
+}
+
+template <class Wait> void Parking<Wait>::notify_all() {
+  if (has_waiters()) {
+    _cv.notify_all();
+  }
+}
+} // namespace detail
+}; // namespace ThreadSafe
@@ -0,0 +1,91 @@
+#pragma once
+
+// Linux下用eventfd把队列的可读状态交给epoll / poll，
+// fd可读当且仅当队列非空或已关闭。这时定义THREAD_SAFE_EVENTFD，
+// Queue随之提供native_handle()
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/eventfd.h>)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#define THREAD_SAFE_EVENTFD 1
+#endif
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+namespace ThreadSafe {
+namespace detail {
+
+// 全部由队列持锁调用。fd在第一次open()时才创建，此前raise / clear
+// 只比较一次整数；只在空和非空之间切换时读写fd，连续的push合并成一次通知
+class Readiness {
+public:
+  Readiness() = default;
+  ~Readiness();
+
+  Readiness(const Readiness &) = delete;
+  Readiness &operator=(const Readiness &) = delete;
+
+#ifdef THREAD_SAFE_EVENTFD
+  // ready为创建时队列是否已经可读，失败时抛出std::system_error
+  int open(bool ready);
+#endif
+  void raise();
+  void clear();
+
+private:
+  int _fd = -1;
+  bool _raised = false;
+};
+
+inline Readiness::~Readiness() {
+#ifdef THREAD_SAFE_EVENTFD
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+#endif
+}
+
+#ifdef THREAD_SAFE_EVENTFD
+inline int Readiness::open(bool ready) {
+  if (_fd < 0) {
+    _fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+    if (ready) {
+      raise();
+    }
+  }
+  return _fd;
+}
+#endif
+
+inline void Readiness::raise() {
+#ifdef THREAD_SAFE_EVENTFD
+  if (_fd < 0 || _raised) {
+    return;
+  }
+  uint64_t one = 1;
+  while (::write(_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+  _raised = true;
+#endif
+}
+
+inline void Readiness::clear() {
+#ifdef THREAD_SAFE_EVENTFD
+  if (!_raised) {
+    return;
+  }
+  // 计数器只会是0或1，读一次即清零；非阻塞fd上不会卡住
+  uint64_t value;
+  while (::read(_fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+  }
+  _raised = false;
+#endif
+}
+} // namespace detail
+}; // namespace ThreadSafe
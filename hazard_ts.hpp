@@ -0,0 +1,164 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace ThreadSafe {
+namespace detail {
+
+// 无锁结构中节点的hazard pointer回收。每次操作借用一条记录，
+// 优先使用按线程编号对应的记录，被占用时依次查找，全部被占用才追加新记录，
+// 所以线程数不超过fixed时每个线程总是拿到自己的记录，不和别人抢缓存行。
+// 退休列表由mutex保护：调用方只在整块节点用完时才retire，频率很低。
+template <class Node, size_t Slots = 2> class Hazards {
+  struct alignas(cache_line) Record {
+    std::atomic<Node *> ptr[Slots] = {};
+    std::atomic<bool> active{false};
+    Record *next = nullptr;
+  };
+
+public:
+  class Guard {
+  public:
+    explicit Guard(Hazards &hazards);
+    ~Guard();
+
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+
+    // 读取src并发布为hazard，返回的节点在Guard析构或再次protect同一槽位前不会被释放
+    Node *protect(size_t slot, const std::atomic<Node *> &src);
+
+  private:
+    Record *_record;
+  };
+
+  Hazards() = default;
+  ~Hazards();
+
+  Hazards(const Hazards &) = delete;
+  Hazards &operator=(const Hazards &) = delete;
+
+  // node已经从结构中摘下，没有被任何hazard引用时delete
+  void retire(Node *node);
+
+private:
+  static constexpr size_t fixed = 64;
+  static constexpr size_t scan_threshold = 8;
+
+  Record *acquire();
+  void scan();
+
+  Record _fixed[fixed];
+  std::atomic<Record *> _overflow{nullptr};
+  std::mutex _retired_lock;
+  std::vector<Node *> _retired;
+};
+
+template <class Node, size_t Slots>
+Hazards<Node, Slots>::Guard::Guard(Hazards &hazards)
+    : _record(hazards.acquire()) {}
+
+template <class Node, size_t Slots> Hazards<Node, Slots>::Guard::~Guard() {
+  for (size_t i = 0; i < Slots; ++i) {
+    _record->ptr[i].store(nullptr, std::memory_order_release);
+  }
+  _record->active.store(false, std::memory_order_release);
+}
+
+template <class Node, size_t Slots>
+Node *Hazards<Node, Slots>::Guard::protect(size_t slot,
+                                           const std::atomic<Node *> &src) {
+  Node *node = src.load(std::memory_order_acquire);
+  for (;;) {
+    _record->ptr[slot].store(node);
+    // 发布之后重新读取：src没变说明回收方扫描时一定能看到这个hazard
+    Node *again = src.load();
+    if (again == node) {
+      return node;
+    }
+    node = again;
+  }
+}
+
+template <class Node, size_t Slots>
+auto Hazards<Node, Slots>::acquire() -> Record * {
+  auto claim = [](Record &record) {
+    return !record.active.load(std::memory_order_relaxed) &&
+           !record.active.exchange(true, std::memory_order_acquire);
+  };
+  size_t start = thread_index() % fixed;
+  for (size_t i = 0; i < fixed; ++i) {
+    Record &record = _fixed[(start + i) % fixed];
+    if (claim(record)) {
+      return &record;
+    }
+  }
+  for (Record *record = _overflow.load(std::memory_order_acquire);
+       record != nullptr; record = record->next) {
+    if (claim(*record)) {
+      return record;
+    }
+  }
+  Record *record = new Record;
+  record->active.store(true, std::memory_order_relaxed);
+  record->next = _overflow.load(std::memory_order_relaxed);
+  while (!_overflow.compare_exchange_weak(record->next, record,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+  return record;
+}
+
+template <class Node, size_t Slots>
+void Hazards<Node, Slots>::retire(Node *node) {
+  std::lock_guard<std::mutex> lock(_retired_lock);
+  _retired.push_back(node);
+  if (_retired.size() >= scan_threshold) {
+    scan();
+  }
+}
+
+template <class Node, size_t Slots> void Hazards<Node, Slots>::scan() {
+  std::vector<Node *> hazards;
+  auto collect = [&](const Record &record) {
+    for (size_t i = 0; i < Slots; ++i) {
+      if (Node *node = record.ptr[i].load()) {
+        hazards.push_back(node);
+      }
+    }
+  };
+  for (const Record &record : _fixed) {
+    collect(record);
+  }
+  for (Record *record = _overflow.load(std::memory_order_acquire);
+       record != nullptr; record = record->next) {
+    collect(*record);
+  }
+  std::sort(hazards.begin(), hazards.end());
+  auto keep = std::partition(_retired.begin(), _retired.end(), [&](Node *n) {
+    return std::binary_search(hazards.begin(), hazards.end(), n);
+  });
+  for (auto it = keep; it != _retired.end(); ++it) {
+    delete *it;
+  }
+  _retired.erase(keep, _retired.end());
+}
+
+template <class Node, size_t Slots> Hazards<Node, Slots>::~Hazards() {
+  for (Node *node : _retired) {
+    delete node;
+  }
+  Record *record = _overflow.load(std::memory_order_relaxed);
+  while (record != nullptr) {
+    Record *next = record->next;
+    delete record;
+    record = next;
+  }
+}
+} // namespace detail
+}; // namespace ThreadSafe
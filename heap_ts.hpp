@@ -0,0 +1,224 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ThreadSafe {
+namespace detail {
+
+template <class Cmp, class T, class = void> struct has_key : std::false_type {};
+
+template <class Cmp, class T>
+struct has_key<Cmp, T,
+               std::void_t<decltype(std::declval<const Cmp &>().key(
+                   std::declval<const T &>()))>> : std::true_type {};
+
+// 4叉堆，语义与std::priority_queue相同：front()是按Cmp最大的元素。
+// 智能指针模式比较的是指针所指的T；如果Cmp提供key(const T&)，
+// 堆在指针旁边缓存key，每层比较不再解引用指针。
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity = 4>
+class Heap {
+  using value_type = stored_t<T, SmartPtr>;
+
+  template <class C, bool = has_key<C, T>::value> struct entry {
+    using type = value_type;
+  };
+  template <class C> struct entry<C, true> {
+    struct type {
+      std::decay_t<decltype(std::declval<const C &>().key(
+          std::declval<const T &>()))>
+          key;
+      value_type value;
+    };
+  };
+  using Entry = typename entry<Cmp>::type;
+
+public:
+  bool empty() const;
+  size_t size() const;
+
+  value_type &front();
+
+  void push(value_type &&value);
+  template <class... Args> void emplace(Args &&...args);
+  void pop();
+
+  // 批量放入：先append，最后heapify_from一次
+  template <class... Args> void append(Args &&...args);
+  void heapify_from(size_t first);
+
+  void swap(Heap &other) noexcept;
+
+private:
+  static const T &get(const value_type &value);
+  static value_type &value_of(Entry &entry);
+  bool less(const Entry &a, const Entry &b) const;
+
+  void sift_up(size_t index);
+  void sift_down(size_t index);
+
+  std::vector<Entry> _entries;
+  Cmp _cmp;
+};
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+bool Heap<T, SmartPtr, Cmp, Arity>::empty() const {
+  return _entries.empty();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+size_t Heap<T, SmartPtr, Cmp, Arity>::size() const {
+  return _entries.size();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+const T &Heap<T, SmartPtr, Cmp, Arity>::get(const value_type &value) {
+  if constexpr (is_inline_v<T, SmartPtr>) {
+    return value;
+  } else {
+    return *value;
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+auto Heap<T, SmartPtr, Cmp, Arity>::value_of(Entry &entry) -> value_type & {
+  if constexpr (has_key<Cmp, T>::value) {
+    return entry.value;
+  } else {
+    return entry;
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+bool Heap<T, SmartPtr, Cmp, Arity>::less(const Entry &a,
+                                         const Entry &b) const {
+  if constexpr (has_key<Cmp, T>::value) {
+    return _cmp(a.key, b.key);
+  } else {
+    return _cmp(get(a), get(b));
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+auto Heap<T, SmartPtr, Cmp, Arity>::front() -> value_type & {
+  return value_of(_entries.front());
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+template <class... Args>
+void Heap<T, SmartPtr, Cmp, Arity>::append(Args &&...args) {
+  if constexpr (has_key<Cmp, T>::value) {
+    value_type value(std::forward<Args>(args)...);
+    auto key = _cmp.key(get(value));
+    _entries.push_back(Entry{std::move(key), std::move(value)});
+  } else {
+    _entries.emplace_back(std::forward<Args>(args)...);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+void Heap<T, SmartPtr, Cmp, Arity>::push(value_type &&value) {
+  emplace(std::move(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+template <class... Args>
+void Heap<T, SmartPtr, Cmp, Arity>::emplace(Args &&...args) {
+  append(std::forward<Args>(args)...);
+  sift_up(_entries.size() - 1);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+void Heap<T, SmartPtr, Cmp, Arity>::pop() {
+  if (_entries.size() > 1) {
+    _entries.front() = std::move(_entries.back());
+    _entries.pop_back();
+    sift_down(0);
+  } else {
+    _entries.pop_back();
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+void Heap<T, SmartPtr, Cmp, Arity>::heapify_from(size_t first) {
+  size_t size = _entries.size();
+  size_t added = size - first;
+  size_t depth = 1;
+  for (size_t n = size; n > 1; n /= Arity) {
+    ++depth;
+  }
+  if (added * depth < size) {
+    for (size_t i = first; i < size; ++i) {
+      sift_up(i);
+    }
+  } else if (size > 1) {
+    for (size_t i = (size - 2) / Arity + 1; i-- > 0;) {
+      sift_down(i);
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+void Heap<T, SmartPtr, Cmp, Arity>::sift_up(size_t index) {
+  Entry hole = std::move(_entries[index]);
+  while (index > 0) {
+    size_t parent = (index - 1) / Arity;
+    if (!less(_entries[parent], hole)) {
+      break;
+    }
+    _entries[index] = std::move(_entries[parent]);
+    index = parent;
+  }
+  _entries[index] = std::move(hole);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+void Heap<T, SmartPtr, Cmp, Arity>::sift_down(size_t index) {
+  size_t size = _entries.size();
+  Entry hole = std::move(_entries[index]);
+  for (;;) {
+    size_t first = index * Arity + 1;
+    if (first >= size) {
+      break;
+    }
+    size_t last = first + Arity < size ? first + Arity : size;
+    size_t best = first;
+    for (size_t child = first + 1; child < last; ++child) {
+      if (less(_entries[best], _entries[child])) {
+        best = child;
+      }
+    }
+    if (!less(hole, _entries[best])) {
+      break;
+    }
+    _entries[index] = std::move(_entries[best]);
+    index = best;
+  }
+  _entries[index] = std::move(hole);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          size_t Arity>
+void Heap<T, SmartPtr, Cmp, Arity>::swap(Heap &other) noexcept {
+  _entries.swap(other._entries);
+  std::swap(_cmp, other._cmp);
+}
+} // namespace detail
+}; // namespace ThreadSafe
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <type_traits>
+
+namespace ThreadSafe {
+
+// IntrusiveQueue的两种实现
+// Locked：mutex保护的单链表，任意多个生产者和消费者
+// Mpsc：Vyukov的无锁侵入式MPSC队列，push只有一次exchange，只允许一个消费者
+struct Locked {};
+struct Mpsc {};
+
+// 嵌入在元素里的链接钩子，一个钩子同一时刻只能在一个队列里。
+// 复制元素时不复制钩子，元素本身仍然可以复制
+class IntrusiveHook {
+public:
+  IntrusiveHook() = default;
+  IntrusiveHook(const IntrusiveHook &) {}
+  IntrusiveHook &operator=(const IntrusiveHook &) { return *this; }
+
+private:
+  template <typename U, IntrusiveHook U::*, class, class>
+  friend class IntrusiveQueue;
+
+  std::atomic<IntrusiveHook *> _next{nullptr};
+  // 钩子所在的元素：push时写入，pop时直接取回，不需要从成员偏移反推
+  void *_owner = nullptr;
+};
+
+// 侵入式队列：push(T*)把元素通过它的钩子串进链表，不分配、不复制，
+// pop原样交回指针。元素的所有权始终归调用方，队列析构时不释放其中的元素。
+// struct Message { IntrusiveHook hook; ... };
+// IntrusiveQueue<Message, &Message::hook, Mpsc> mailbox;
+template <typename T, IntrusiveHook T::*Hook, class Mode = Locked,
+          class Wait = Block>
+class alignas(detail::cache_line) IntrusiveQueue {
+  static_assert(std::is_same_v<Mode, Locked> || std::is_same_v<Mode, Mpsc>,
+                "Mode must be Locked or Mpsc");
+
+public:
+  IntrusiveQueue();
+
+  IntrusiveQueue(const IntrusiveQueue &) = delete;
+  IntrusiveQueue &operator=(const IntrusiveQueue &) = delete;
+
+  // 无界，close()之前总是成功；close()之后返回false，元素没有入队
+  bool push(T *value);
+  // 无界队列不会满，与push相同，只是为了与其它队列的接口一致
+  bool push_try(T *value);
+
+  // 空时返回nullptr；Mpsc模式下只能由同一个消费者线程调用
+  T *pop_must();
+  T *pop_try();
+
+  template <class Rep, class Period>
+  T *pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  T *pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // 语义与RingQueue相同
+  void close();
+  bool closed() const;
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+private:
+  void link(IntrusiveHook *hook);
+  IntrusiveHook *unlink();
+
+  // Locked：_lock保护_first和_last；Mpsc：没有锁，消费者独占_first和_stub，
+  // 生产者只交换_last，两边不共享缓存行
+  using Lock = std::conditional_t<std::is_same_v<Mode, Locked>, std::mutex,
+                                  detail::Empty>;
+
+  alignas(detail::cache_line) Lock _lock;
+  IntrusiveHook *_first;
+  IntrusiveHook _stub;
+  alignas(detail::cache_line) std::atomic<IntrusiveHook *> _last;
+  alignas(detail::cache_line) std::atomic<size_t> _count{0};
+  std::atomic<bool> _closed{false};
+  alignas(detail::cache_line) detail::Parking<Wait> _not_empty;
+};
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+IntrusiveQueue<T, Hook, Mode, Wait>::IntrusiveQueue() {
+  if constexpr (std::is_same_v<Mode, Mpsc>) {
+    // 链表里总有一个节点：空队列时只有_stub
+    _first = &_stub;
+    _last.store(&_stub, std::memory_order_relaxed);
+  } else {
+    _first = nullptr;
+    _last.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+void IntrusiveQueue<T, Hook, Mode, Wait>::link(IntrusiveHook *hook) {
+  hook->_next.store(nullptr, std::memory_order_relaxed);
+  if constexpr (std::is_same_v<Mode, Mpsc>) {
+    IntrusiveHook *prev = _last.exchange(hook, std::memory_order_acq_rel);
+    // exchange之后、这次store之前，消费者看到的链表在prev处断开
+    prev->_next.store(hook, std::memory_order_release);
+  } else {
+    std::lock_guard<std::mutex> lock(_lock);
+    IntrusiveHook *last = _last.load(std::memory_order_relaxed);
+    if (last == nullptr) {
+      _first = hook;
+    } else {
+      last->_next.store(hook, std::memory_order_relaxed);
+    }
+    _last.store(hook, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+IntrusiveHook *IntrusiveQueue<T, Hook, Mode, Wait>::unlink() {
+  if constexpr (std::is_same_v<Mode, Mpsc>) {
+    IntrusiveHook *first = _first;
+    IntrusiveHook *next = first->_next.load(std::memory_order_acquire);
+    if (first == &_stub) {
+      if (next == nullptr) {
+        return nullptr;
+      }
+      _first = next;
+      first = next;
+      next = next->_next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+      _first = next;
+      return first;
+    }
+    // first是最后一个节点：还有生产者没有接上链表时先不取，等它的通知
+    if (first != _last.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    // 把_stub接到末尾，first就有了后继，可以取下
+    link(&_stub);
+    next = first->_next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      _first = next;
+      return first;
+    }
+    return nullptr;
+  } else {
+    std::lock_guard<std::mutex> lock(_lock);
+    IntrusiveHook *first = _first;
+    if (first != nullptr) {
+      _first = first->_next.load(std::memory_order_relaxed);
+      if (_first == nullptr) {
+        _last.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    return first;
+  }
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+bool IntrusiveQueue<T, Hook, Mode, Wait>::push(T *value) {
+  if (closed()) {
+    return false;
+  }
+  IntrusiveHook &hook = value->*Hook;
+  hook._owner = value;
+  _count.fetch_add(1, std::memory_order_relaxed);
+  link(&hook);
+  _not_empty.notify_one();
+  return true;
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+bool IntrusiveQueue<T, Hook, Mode, Wait>::push_try(T *value) {
+  return push(value);
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+T *IntrusiveQueue<T, Hook, Mode, Wait>::pop_try() {
+  IntrusiveHook *hook = unlink();
+  if (hook == nullptr) {
+    return nullptr;
+  }
+  _count.fetch_sub(1, std::memory_order_relaxed);
+  return static_cast<T *>(hook->_owner);
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+T *IntrusiveQueue<T, Hook, Mode, Wait>::pop_must() {
+  T *value = nullptr;
+  _not_empty.wait([&]() {
+    bool stop = closed();
+    return (value = pop_try()) != nullptr || stop;
+  });
+  return value;
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+template <class Rep, class Period>
+T *IntrusiveQueue<T, Hook, Mode, Wait>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+template <class Clock, class Duration>
+T *IntrusiveQueue<T, Hook, Mode, Wait>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  T *value = nullptr;
+  _not_empty.wait_until(
+      [&]() {
+        bool stop = closed();
+        return (value = pop_try()) != nullptr || stop;
+      },
+      timeout_time);
+  return value;
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+void IntrusiveQueue<T, Hook, Mode, Wait>::close() {
+  _closed.store(true);
+  _not_empty.notify_all();
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+bool IntrusiveQueue<T, Hook, Mode, Wait>::closed() const {
+  return _closed.load(std::memory_order_acquire);
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+template <class OutputIt>
+size_t IntrusiveQueue<T, Hook, Mode, Wait>::drain_into(OutputIt out) {
+  size_t count = 0;
+  for (T *value; (value = pop_try()) != nullptr; ++count) {
+    *out = value;
+    ++out;
+  }
+  return count;
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+size_t IntrusiveQueue<T, Hook, Mode, Wait>::size_approx() const {
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, IntrusiveHook T::*Hook, class Mode, class Wait>
+bool IntrusiveQueue<T, Hook, Mode, Wait>::empty_approx() const {
+  return size_approx() == 0;
+}
+}; // namespace ThreadSafe
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+namespace ThreadSafe {
+
+// 固定个数的优先级通道，每个通道是一个FIFO，编号越大优先级越高。
+// 非空通道记在一个64位掩码里，pop用一次最高位查找(countl_zero)得到要取的通道，
+// push / pop都是O(1)，没有堆的O(log n)比较；同一通道内严格FIFO，
+// 高优先级通道非空时低优先级通道的元素不会被取出。
+template <typename T, template <typename> class SmartPtr, size_t Lanes = 8>
+class alignas(detail::cache_line) LaneQueue {
+  static_assert(detail::is_storage_v<T, SmartPtr>,
+                "SmartPtr must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+  static_assert(Lanes >= 1 && Lanes <= 64, "Lanes must be in [1, 64]");
+
+public:
+  LaneQueue() = default;
+
+  LaneQueue(const LaneQueue &) = delete;
+  LaneQueue &operator=(const LaneQueue &) = delete;
+
+  static constexpr size_t lanes() { return Lanes; }
+
+  // lane >= Lanes或close()之后返回false
+  bool push(const T &value, size_t lane);
+  bool push(T &&value, size_t lane);
+
+  template <class... Args> bool emplace(size_t lane, Args &&...args);
+
+  // 取最高优先级的非空通道的队首
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  void close();
+  bool closed() const;
+  // 按优先级从高到低写入out，返回个数
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  size_t size() const;
+  size_t size(size_t lane) const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+private:
+  SmartPtr<T> take(std::unique_lock<std::mutex> &lock);
+
+  alignas(detail::cache_line) mutable std::mutex _lock;
+  // 第i位表示第i个通道非空
+  uint64_t _mask = 0;
+  size_t _waiters = 0;
+  std::queue<detail::stored_t<T, SmartPtr>> _lanes[Lanes];
+  alignas(detail::cache_line) std::condition_variable _cv;
+  alignas(detail::cache_line) std::atomic<size_t> _count{0};
+  std::atomic<bool> _closed{false};
+};
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+bool LaneQueue<T, SmartPtr, Lanes>::push(const T &value, size_t lane) {
+  return emplace(lane, value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+bool LaneQueue<T, SmartPtr, Lanes>::push(T &&value, size_t lane) {
+  return emplace(lane, std::move(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+template <class... Args>
+bool LaneQueue<T, SmartPtr, Lanes>::emplace(size_t lane, Args &&...args) {
+  if (lane >= Lanes || closed()) {
+    return false;
+  }
+  // 指针模式在加锁之前分配
+  detail::stored_t<T, SmartPtr> value = [&]() {
+    if constexpr (detail::is_inline_v<T, SmartPtr>) {
+      return T(std::forward<Args>(args)...);
+    } else {
+      return detail::make_smart<T, SmartPtr>(std::forward<Args>(args)...);
+    }
+  }();
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    if (closed()) {
+      return false;
+    }
+    _lanes[lane].push(std::move(value));
+    _mask |= uint64_t(1) << lane;
+    _count.store(_count.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+    wake = _waiters > 0;
+  }
+  if (wake) {
+    _cv.notify_one();
+  }
+  return true;
+}
+
+// 持锁调用，_mask非空
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+SmartPtr<T>
+LaneQueue<T, SmartPtr, Lanes>::take(std::unique_lock<std::mutex> &lock) {
+  size_t lane = detail::highest_bit(_mask);
+  auto &queue = _lanes[lane];
+  SmartPtr<T> value(std::move(queue.front()));
+  queue.pop();
+  if (queue.empty()) {
+    _mask &= ~(uint64_t(1) << lane);
+  }
+  _count.store(_count.load(std::memory_order_relaxed) - 1,
+               std::memory_order_relaxed);
+  lock.unlock();
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+SmartPtr<T> LaneQueue<T, SmartPtr, Lanes>::pop_must() {
+  std::unique_lock<std::mutex> lock(_lock);
+  if (_mask == 0 && !closed()) {
+    ++_waiters;
+    _cv.wait(lock, [this]() { return _mask != 0 || closed(); });
+    --_waiters;
+  }
+  if (_mask == 0) {
+    return {};
+  }
+  return take(lock);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+SmartPtr<T> LaneQueue<T, SmartPtr, Lanes>::pop_try() {
+  std::unique_lock<std::mutex> lock(_lock);
+  if (_mask == 0) {
+    return {};
+  }
+  return take(lock);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+template <class Rep, class Period>
+SmartPtr<T> LaneQueue<T, SmartPtr, Lanes>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+template <class Clock, class Duration>
+SmartPtr<T> LaneQueue<T, SmartPtr, Lanes>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  std::unique_lock<std::mutex> lock(_lock);
+  if (_mask == 0 && !closed()) {
+    ++_waiters;
+    _cv.wait_until(lock, timeout_time,
+                   [this]() { return _mask != 0 || closed(); });
+    --_waiters;
+  }
+  if (_mask == 0) {
+    return {};
+  }
+  return take(lock);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+void LaneQueue<T, SmartPtr, Lanes>::close() {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _closed.store(true, std::memory_order_relaxed);
+  }
+  _cv.notify_all();
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+bool LaneQueue<T, SmartPtr, Lanes>::closed() const {
+  return _closed.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+template <class OutputIt>
+size_t LaneQueue<T, SmartPtr, Lanes>::drain_into(OutputIt out) {
+  std::queue<detail::stored_t<T, SmartPtr>> lanes[Lanes];
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+      lanes[lane].swap(_lanes[lane]);
+    }
+    _mask = 0;
+    _count.store(0, std::memory_order_relaxed);
+  }
+  size_t count = 0;
+  for (size_t lane = Lanes; lane-- > 0;) {
+    for (; !lanes[lane].empty(); lanes[lane].pop()) {
+      *out = std::move(lanes[lane].front());
+      ++out;
+      ++count;
+    }
+  }
+  return count;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+size_t LaneQueue<T, SmartPtr, Lanes>::size() const {
+  std::lock_guard<std::mutex> lock(_lock);
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+size_t LaneQueue<T, SmartPtr, Lanes>::size(size_t lane) const {
+  std::lock_guard<std::mutex> lock(_lock);
+  return lane < Lanes ? _lanes[lane].size() : 0;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+size_t LaneQueue<T, SmartPtr, Lanes>::size_approx() const {
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Lanes>
+bool LaneQueue<T, SmartPtr, Lanes>::empty_approx() const {
+  return size_approx() == 0;
+}
+}; // namespace ThreadSafe
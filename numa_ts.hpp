@@ -0,0 +1,498 @@
+#pragma once
+
+#include "detail_ts.hpp"
+#include "queue_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ThreadSafe {
+
+// NUMA拓扑：每个节点上的CPU编号。system()在第一次调用时读取
+// /sys/devices/system/node，读不到(非Linux或没有NUMA)时视为只有一个节点
+class NumaTopology {
+public:
+  NumaTopology() = default;
+  // nodes[i]为节点i上的CPU编号，可以用来在单节点机器上模拟多节点
+  explicit NumaTopology(std::vector<std::vector<int>> nodes);
+
+  static const NumaTopology &system();
+
+  size_t node_count() const;
+  const std::vector<int> &cpus(size_t node) const;
+  // 不属于任何节点的CPU算作节点0
+  size_t node_of(int cpu) const;
+  // 当前线程所在的节点：Linux下由sched_getcpu()换算，线程迁移后随之改变
+  size_t current_node() const;
+
+private:
+  static std::vector<int> parse_list(const std::string &text);
+  static bool read_line(const std::string &path, std::string &line);
+
+  std::vector<std::vector<int>> _nodes;
+  std::vector<size_t> _node_of;
+};
+
+inline NumaTopology::NumaTopology(std::vector<std::vector<int>> nodes)
+    : _nodes(std::move(nodes)) {
+  if (_nodes.empty()) {
+    _nodes.emplace_back();
+  }
+  for (size_t node = 0; node < _nodes.size(); ++node) {
+    for (int cpu : _nodes[node]) {
+      if (cpu < 0) {
+        continue;
+      }
+      if (static_cast<size_t>(cpu) >= _node_of.size()) {
+        _node_of.resize(static_cast<size_t>(cpu) + 1, 0);
+      }
+      _node_of[static_cast<size_t>(cpu)] = node;
+    }
+  }
+}
+
+inline bool NumaTopology::read_line(const std::string &path,
+                                    std::string &line) {
+  std::FILE *file = std::fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char buffer[4096];
+  bool ok = std::fgets(buffer, sizeof(buffer), file) != nullptr;
+  std::fclose(file);
+  if (ok) {
+    line = buffer;
+  }
+  return ok;
+}
+
+// 解析"0-3,8,10-11"这样的列表
+inline std::vector<int> NumaTopology::parse_list(const std::string &text) {
+  std::vector<int> values;
+  const char *p = text.c_str();
+  while (*p != '\0') {
+    char *end;
+    long first = std::strtol(p, &end, 10);
+    if (end == p) {
+      break;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = std::strtol(p + 1, &end, 10);
+      p = end;
+    }
+    for (long value = first; value <= last; ++value) {
+      values.push_back(static_cast<int>(value));
+    }
+    if (*p != ',') {
+      break;
+    }
+    ++p;
+  }
+  return values;
+}
+
+inline const NumaTopology &NumaTopology::system() {
+  static const NumaTopology topology = []() {
+    std::vector<std::vector<int>> nodes;
+    std::string line;
+    if (read_line("/sys/devices/system/node/online", line)) {
+      for (int node : parse_list(line)) {
+        std::string cpus;
+        std::string path = "/sys/devices/system/node/node" +
+                           std::to_string(node) + "/cpulist";
+        if (node >= 0 && read_line(path, cpus)) {
+          if (nodes.size() <= static_cast<size_t>(node)) {
+            nodes.resize(static_cast<size_t>(node) + 1);
+          }
+          nodes[static_cast<size_t>(node)] = parse_list(cpus);
+        }
+      }
+    }
+    if (nodes.empty()) {
+      std::vector<int> cpus;
+      for (unsigned i = 0; i < std::thread::hardware_concurrency(); ++i) {
+        cpus.push_back(static_cast<int>(i));
+      }
+      nodes.push_back(std::move(cpus));
+    }
+    return NumaTopology(std::move(nodes));
+  }();
+  return topology;
+}
+
+inline size_t NumaTopology::node_count() const { return _nodes.size(); }
+
+inline const std::vector<int> &NumaTopology::cpus(size_t node) const {
+  return _nodes[node];
+}
+
+inline size_t NumaTopology::node_of(int cpu) const {
+  if (cpu < 0 || static_cast<size_t>(cpu) >= _node_of.size()) {
+    return 0;
+  }
+  return _node_of[static_cast<size_t>(cpu)];
+}
+
+inline size_t NumaTopology::current_node() const {
+#ifdef __linux__
+  if (_nodes.size() > 1) {
+    return node_of(sched_getcpu());
+  }
+#endif
+  return 0;
+}
+
+namespace detail {
+
+// 在指定节点上分配整页内存：Linux下mmap之后以mbind(MPOL_PREFERRED)绑定，
+// 内核不支持或没有权限时退化为普通的首次访问分配
+inline void *allocate_on_node(size_t bytes, size_t node) {
+#ifdef __linux__
+  void *memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+#ifdef SYS_mbind
+  constexpr int mpol_preferred = 1;
+  unsigned long mask[4] = {};
+  if (node < sizeof(mask) * 8) {
+    mask[node / (sizeof(unsigned long) * 8)] |=
+        1UL << (node % (sizeof(unsigned long) * 8));
+    ::syscall(SYS_mbind, memory, bytes, mpol_preferred, mask,
+              sizeof(mask) * 8, 0);
+  }
+#endif
+  return memory;
+#else
+  (void)node;
+  return ::operator new(bytes);
+#endif
+}
+
+inline void free_on_node(void *memory, size_t bytes) {
+#ifdef __linux__
+  ::munmap(memory, bytes);
+#else
+  (void)bytes;
+  ::operator delete(memory);
+#endif
+}
+} // namespace detail
+
+// NUMA感知的分片队列：每个节点一组Queue分片，分片对象(锁、计数、等待状态)
+// 分配在所属节点的内存上，元素由本节点的生产者首次访问分配。生产者放入当前
+// 节点的分片，消费者先取本节点的元素，本节点为空时只从积压达到steal_threshold
+// 的其它节点窃取。每个节点有自己的Parking，生产者只唤醒本节点的消费者，
+// 积压达到阈值后才唤醒其它节点的消费者。
+// steal_threshold大于1时，低于阈值的元素只能由本节点的消费者取走，
+// 所以有生产者的节点上也需要有消费者。
+template <typename T, template <typename> class SmartPtr, class Wait = Block>
+class NumaQueue {
+public:
+  // shards_per_node为0时每个节点的分片数等于该节点的CPU数
+  explicit NumaQueue(size_t steal_threshold = 1, size_t shards_per_node = 0,
+                     const NumaTopology &topology = NumaTopology::system());
+  ~NumaQueue();
+
+  NumaQueue(const NumaQueue &) = delete;
+  NumaQueue &operator=(const NumaQueue &) = delete;
+
+  // close()之后返回false
+  bool push(const T &value);
+  bool push(T &&value);
+
+  template <class... Args> bool emplace(Args &&...args);
+
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // 关闭所有分片；阻塞的pop在所有分片取空后返回空值
+  void close();
+  bool closed() const;
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  size_t size() const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+  size_t node_count() const;
+  size_t steal_threshold() const;
+
+private:
+  using shard_type = Queue<T, SmartPtr>;
+
+  struct alignas(detail::cache_line) Node {
+    // 本节点分片里的元素数，push之前加、pop之后减，只作为窃取的依据
+    std::atomic<size_t> backlog{0};
+    detail::Parking<Wait> parking;
+    shard_type *shards = nullptr;
+    size_t shard_count = 0;
+    size_t bytes = 0;
+  };
+
+  size_t current() const;
+  SmartPtr<T> pop_node(Node &node);
+  SmartPtr<T> pop_from(size_t node);
+  template <class Block> SmartPtr<T> pop_wait(Block block);
+
+  NumaTopology _topology;
+  size_t _steal_threshold;
+  std::vector<Node *> _nodes;
+  std::atomic<bool> _closed{false};
+};
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+NumaQueue<T, SmartPtr, Wait>::NumaQueue(size_t steal_threshold,
+                                        size_t shards_per_node,
+                                        const NumaTopology &topology)
+    : _topology(topology),
+      _steal_threshold(steal_threshold > 0 ? steal_threshold : 1) {
+  size_t page = 4096;
+#ifdef __linux__
+  long size = ::sysconf(_SC_PAGESIZE);
+  page = size > 0 ? static_cast<size_t>(size) : page;
+#endif
+  for (size_t i = 0; i < _topology.node_count(); ++i) {
+    size_t count = shards_per_node;
+    if (count == 0) {
+      count = _topology.cpus(i).empty() ? 1 : _topology.cpus(i).size();
+    }
+    // Node和它的分片放在同一块按页对齐的内存里
+    size_t offset = (sizeof(Node) + alignof(shard_type) - 1) /
+                    alignof(shard_type) * alignof(shard_type);
+    size_t bytes = offset + count * sizeof(shard_type);
+    bytes = (bytes + page - 1) / page * page;
+    char *memory = static_cast<char *>(detail::allocate_on_node(bytes, i));
+    Node *node = new (memory) Node;
+    node->shards = reinterpret_cast<shard_type *>(memory + offset);
+    for (size_t s = 0; s < count; ++s) {
+      new (node->shards + s) shard_type;
+    }
+    node->shard_count = count;
+    node->bytes = bytes;
+    _nodes.push_back(node);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+NumaQueue<T, SmartPtr, Wait>::~NumaQueue() {
+  for (Node *node : _nodes) {
+    for (size_t s = 0; s < node->shard_count; ++s) {
+      node->shards[s].~shard_type();
+    }
+    size_t bytes = node->bytes;
+    node->~Node();
+    detail::free_on_node(node, bytes);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t NumaQueue<T, SmartPtr, Wait>::current() const {
+  size_t node = _topology.current_node();
+  return node < _nodes.size() ? node : 0;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t NumaQueue<T, SmartPtr, Wait>::node_count() const {
+  return _nodes.size();
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t NumaQueue<T, SmartPtr, Wait>::steal_threshold() const {
+  return _steal_threshold;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t NumaQueue<T, SmartPtr, Wait>::size() const {
+  size_t size = 0;
+  for (const Node *node : _nodes) {
+    for (size_t s = 0; s < node->shard_count; ++s) {
+      size += node->shards[s].size();
+    }
+  }
+  return size;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t NumaQueue<T, SmartPtr, Wait>::size_approx() const {
+  size_t size = 0;
+  for (const Node *node : _nodes) {
+    size += node->backlog.load(std::memory_order_relaxed);
+  }
+  return size;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool NumaQueue<T, SmartPtr, Wait>::empty_approx() const {
+  return size_approx() == 0;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool NumaQueue<T, SmartPtr, Wait>::push(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool NumaQueue<T, SmartPtr, Wait>::push(T &&value) {
+  return emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class... Args>
+bool NumaQueue<T, SmartPtr, Wait>::emplace(Args &&...args) {
+  size_t index = current();
+  Node &node = *_nodes[index];
+  shard_type &shard = node.shards[detail::thread_index() % node.shard_count];
+  // 先计数再放入，pop之后的减法不会让计数短暂地小于0
+  size_t backlog = node.backlog.fetch_add(1) + 1;
+  if (!shard.emplace(std::forward<Args>(args)...)) {
+    node.backlog.fetch_sub(1);
+    return false;
+  }
+  node.parking.notify_one();
+  // 积压达到阈值，其它节点的消费者可以来窃取了
+  if (backlog >= _steal_threshold) {
+    for (size_t i = 0; i < _nodes.size(); ++i) {
+      if (i != index) {
+        _nodes[i]->parking.notify_one();
+      }
+    }
+  }
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+SmartPtr<T> NumaQueue<T, SmartPtr, Wait>::pop_node(Node &node) {
+  size_t start = detail::thread_index();
+  for (size_t i = 0; i < node.shard_count; ++i) {
+    shard_type &shard = node.shards[(start + i) % node.shard_count];
+    if (shard.empty_approx()) {
+      continue;
+    }
+    if (SmartPtr<T> value = shard.pop_try()) {
+      node.backlog.fetch_sub(1);
+      return value;
+    }
+  }
+  return {};
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+SmartPtr<T> NumaQueue<T, SmartPtr, Wait>::pop_from(size_t index) {
+  if (SmartPtr<T> value = pop_node(*_nodes[index])) {
+    return value;
+  }
+  // 关闭之后不再有新元素，剩下的不论多少都可以窃取
+  size_t threshold = closed() ? 1 : _steal_threshold;
+  for (size_t i = 1; i < _nodes.size(); ++i) {
+    Node &remote = *_nodes[(index + i) % _nodes.size()];
+    if (remote.backlog.load(std::memory_order_relaxed) < threshold) {
+      continue;
+    }
+    if (SmartPtr<T> value = pop_node(remote)) {
+      return value;
+    }
+  }
+  return {};
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+SmartPtr<T> NumaQueue<T, SmartPtr, Wait>::pop_try() {
+  return pop_from(current());
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class Block>
+SmartPtr<T> NumaQueue<T, SmartPtr, Wait>::pop_wait(Block block) {
+  // 等待期间线程可能迁移到别的节点，始终在开始时的节点上等待
+  size_t index = current();
+  SmartPtr<T> value;
+  block(_nodes[index]->parking, [&]() {
+    // 先读closed：看到关闭时，关闭之前完成的push一定能被下面的pop看到
+    bool stop = closed();
+    value = pop_from(index);
+    return value || stop;
+  });
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+SmartPtr<T> NumaQueue<T, SmartPtr, Wait>::pop_must() {
+  return pop_wait([](detail::Parking<Wait> &parking, auto ready) {
+    parking.wait(ready);
+  });
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class Rep, class Period>
+SmartPtr<T> NumaQueue<T, SmartPtr, Wait>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class Clock, class Duration>
+SmartPtr<T> NumaQueue<T, SmartPtr, Wait>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return pop_wait([&](detail::Parking<Wait> &parking, auto ready) {
+    parking.wait_until(ready, timeout_time);
+  });
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+void NumaQueue<T, SmartPtr, Wait>::close() {
+  for (Node *node : _nodes) {
+    for (size_t s = 0; s < node->shard_count; ++s) {
+      node->shards[s].close();
+    }
+  }
+  _closed.store(true);
+  for (Node *node : _nodes) {
+    node->parking.notify_all();
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool NumaQueue<T, SmartPtr, Wait>::closed() const {
+  return _closed.load(std::memory_order_acquire);
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class OutputIt>
+size_t NumaQueue<T, SmartPtr, Wait>::drain_into(OutputIt out) {
+  size_t count = 0;
+  for (Node *node : _nodes) {
+    for (size_t s = 0; s < node->shard_count; ++s) {
+      size_t drained =
+          node->shards[s].template drain_into<OutputIt &>(out);
+      node->backlog.fetch_sub(drained);
+      count += drained;
+    }
+  }
+  return count;
+}
+}; // namespace ThreadSafe
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "detail_ts.hpp"
+#include "queue_ts.hpp"
+#include "ring_ts.hpp"
+#include "segmented_ts.hpp"
+#include "spsc_ts.hpp"
+#include "stats_ts.hpp"
+
+#include <cstddef>
+#include <type_traits>
+
+namespace ThreadSafe {
+
+// BasicQueue的策略参数
+struct SingleProducer {};
+struct MultiProducer {};
+struct SingleConsumer {};
+struct MultiConsumer {};
+struct Unbounded {};
+template <size_t Capacity> struct Bounded {};
+
+namespace detail {
+template <class Bound> struct bound_traits {
+  static constexpr bool bounded = false;
+  static constexpr size_t capacity = 0;
+};
+
+template <size_t Capacity> struct bound_traits<Bounded<Capacity>> {
+  static constexpr bool bounded = true;
+  static constexpr size_t capacity = Capacity;
+};
+
+// 带统计的定长队列：只有Queue实现了Stats，容量在编译期给定
+template <typename T, template <typename> class Storage, size_t Capacity,
+          class Wait, class Stats>
+class BoundedQueue : public Queue<T, Storage, void, Wait, Stats> {
+public:
+  BoundedQueue() : Queue<T, Storage, void, Wait, Stats>(Capacity) {}
+};
+
+template <typename T, template <typename> class Storage, class Producers,
+          class Consumers, class Bound, class Wait, class Stats>
+struct select_queue {
+  static_assert(is_storage_v<T, Storage>,
+                "Storage must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+  static_assert(std::is_same_v<Producers, SingleProducer> ||
+                    std::is_same_v<Producers, MultiProducer>,
+                "Producers must be SingleProducer or MultiProducer");
+  static_assert(std::is_same_v<Consumers, SingleConsumer> ||
+                    std::is_same_v<Consumers, MultiConsumer>,
+                "Consumers must be SingleConsumer or MultiConsumer");
+  static_assert(std::is_same_v<Bound, Unbounded> ||
+                    bound_traits<Bound>::bounded,
+                "Bound must be Unbounded or Bounded<Capacity>");
+
+  static constexpr bool spsc = std::is_same_v<Producers, SingleProducer> &&
+                               std::is_same_v<Consumers, SingleConsumer>;
+  static constexpr bool bounded = bound_traits<Bound>::bounded;
+  static constexpr size_t capacity = bound_traits<Bound>::capacity;
+
+  template <class Q> struct type_identity {
+    using type = Q;
+  };
+
+  static auto pick() {
+    if constexpr (!std::is_same_v<Stats, NoStats>) {
+      if constexpr (bounded) {
+        return type_identity<BoundedQueue<T, Storage, capacity, Wait, Stats>>{};
+      } else {
+        return type_identity<Queue<T, Storage, void, Wait, Stats>>{};
+      }
+    } else if constexpr (bounded && spsc) {
+      return type_identity<SpscQueue<T, Storage, capacity, Wait>>{};
+    } else if constexpr (bounded) {
+      return type_identity<RingQueue<T, Storage, capacity, Wait>>{};
+    } else {
+      return type_identity<SegmentedQueue<T, Storage, 256, Wait>>{};
+    }
+  }
+
+  using type = typename decltype(pick())::type;
+};
+} // namespace detail
+
+// 按策略在编译期选择具体的队列类型，每种组合只包含它需要的代码：
+//   Bounded<N> + SingleProducer + SingleConsumer -> SpscQueue，
+//     下标只有acquire/release，没有RMW；唤醒检查另有一次relaxed load
+//     (Linux上membarrier不可用时加一次seq_cst fence，BusyPoll时没有)
+//   Bounded<N>的其它组合 -> RingQueue，无锁MPMC
+//   Unbounded -> SegmentedQueue，无锁MPMC
+//   Stats不是NoStats时 -> Queue(mutex)，Bounded<N>时容量为N
+// 单生产者多消费者、多生产者单消费者没有专门的实现，使用MPMC的类型。
+// 需要优先级(Cmp)或协程/select/eventfd时直接使用Queue。
+// 例如 BasicQueue<int, Inline, SingleProducer, SingleConsumer, Bounded<1024>,
+//                 Spin<128>>：没有mutex(只有睡眠时才用到)，没有堆分配
+template <typename T, template <typename> class Storage = std::unique_ptr,
+          class Producers = MultiProducer, class Consumers = MultiConsumer,
+          class Bound = Unbounded, class Wait = Block, class Stats = NoStats>
+using BasicQueue = typename detail::select_queue<T, Storage, Producers,
+                                                 Consumers, Bound, Wait,
+                                                 Stats>::type;
+}; // namespace ThreadSafe
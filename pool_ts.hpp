@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace ThreadSafe {
+namespace detail {
+
+// 按(大小, 对齐)区分的定长块池。每个线程有一份本地空闲链表，
+// 只有本地链表为空或过长时才以批量方式和全局链表交换，全局链表由mutex保护。
+// 块按slab申请，永不归还给系统；全局部分故意不析构，避免静态析构顺序问题。
+template <size_t Size, size_t Align> class Pool {
+public:
+  static void *allocate();
+  static void deallocate(void *ptr);
+
+private:
+  struct Block {
+    Block *next;
+  };
+
+  static constexpr size_t block_align =
+      Align > alignof(Block) ? Align : alignof(Block);
+  static constexpr size_t block_size =
+      ((Size > sizeof(Block) ? Size : sizeof(Block)) + block_align - 1) /
+      block_align * block_align;
+  static constexpr size_t slab_blocks = 64;
+  static constexpr size_t batch = 64;
+  static constexpr size_t cache_limit = 2 * batch;
+
+  struct Central {
+    std::mutex lock;
+    Block *free = nullptr;
+  };
+
+  // 保持平凡析构，线程退出后(例如静态对象析构时)仍然可以安全访问
+  struct Cache {
+    Block *free = nullptr;
+    size_t count = 0;
+    bool exited = false;
+  };
+
+  struct Reaper {
+    ~Reaper();
+  };
+
+  static Central &central();
+  static Cache &local();
+  static Cache &cache();
+  static void refill(Cache &cache);
+  static void release(Cache &cache, size_t count);
+};
+
+template <size_t Size, size_t Align>
+auto Pool<Size, Align>::central() -> Central & {
+  static Central *central = new Central;
+  return *central;
+}
+
+template <size_t Size, size_t Align>
+auto Pool<Size, Align>::local() -> Cache & {
+  thread_local Cache cache;
+  return cache;
+}
+
+template <size_t Size, size_t Align>
+auto Pool<Size, Align>::cache() -> Cache & {
+  thread_local Reaper reaper;
+  (void)reaper;
+  return local();
+}
+
+template <size_t Size, size_t Align> Pool<Size, Align>::Reaper::~Reaper() {
+  Cache &cache = local();
+  release(cache, cache.count);
+  cache.exited = true;
+}
+
+template <size_t Size, size_t Align>
+void Pool<Size, Align>::release(Cache &cache, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  Block *first = cache.free;
+  Block *last = first;
+  for (size_t i = 1; i < count; ++i) {
+    last = last->next;
+  }
+  cache.free = last->next;
+  cache.count -= count;
+  Central &shared = central();
+  std::lock_guard<std::mutex> lock(shared.lock);
+  last->next = shared.free;
+  shared.free = first;
+}
+
+template <size_t Size, size_t Align>
+void Pool<Size, Align>::refill(Cache &cache) {
+  {
+    Central &shared = central();
+    std::lock_guard<std::mutex> lock(shared.lock);
+    while (shared.free != nullptr && cache.count < batch) {
+      Block *block = shared.free;
+      shared.free = block->next;
+      block->next = cache.free;
+      cache.free = block;
+      ++cache.count;
+    }
+  }
+  if (cache.count > 0) {
+    return;
+  }
+  char *slab = static_cast<char *>(::operator new(
+      block_size * slab_blocks, std::align_val_t(block_align)));
+  for (size_t i = slab_blocks; i-- > 0;) {
+    Block *block = reinterpret_cast<Block *>(slab + i * block_size);
+    block->next = cache.free;
+    cache.free = block;
+  }
+  cache.count = slab_blocks;
+}
+
+template <size_t Size, size_t Align> void *Pool<Size, Align>::allocate() {
+  Cache &local = cache();
+  if (local.free == nullptr) {
+    refill(local);
+  }
+  Block *block = local.free;
+  local.free = block->next;
+  --local.count;
+  return block;
+}
+
+template <size_t Size, size_t Align>
+void Pool<Size, Align>::deallocate(void *ptr) {
+  Cache &local = cache();
+  Block *block = static_cast<Block *>(ptr);
+  block->next = local.free;
+  local.free = block;
+  if (local.exited) {
+    release(local, ++local.count);
+  } else if (++local.count > cache_limit) {
+    release(local, batch);
+  }
+}
+} // namespace detail
+
+template <typename T> struct PoolDeleter {
+  void operator()(T *ptr) const;
+};
+
+template <typename T> void PoolDeleter<T>::operator()(T *ptr) const {
+  ptr->~T();
+  detail::Pool<sizeof(T), alignof(T)>::deallocate(ptr);
+}
+
+// allocate_shared使用的分配器，对象和控制块在同一个池化块中
+template <typename T> class PoolAllocator {
+public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <typename U> PoolAllocator(const PoolAllocator<U> &) {}
+
+  T *allocate(size_t n);
+  void deallocate(T *ptr, size_t n);
+
+  template <typename U> bool operator==(const PoolAllocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const PoolAllocator<U> &) const {
+    return false;
+  }
+};
+
+template <typename T> T *PoolAllocator<T>::allocate(size_t n) {
+  if (n == 1) {
+    return static_cast<T *>(detail::Pool<sizeof(T), alignof(T)>::allocate());
+  }
+  return static_cast<T *>(
+      ::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+}
+
+template <typename T> void PoolAllocator<T>::deallocate(T *ptr, size_t n) {
+  if (n == 1) {
+    detail::Pool<sizeof(T), alignof(T)>::deallocate(ptr);
+  } else {
+    ::operator delete(ptr, std::align_val_t(alignof(T)));
+  }
+}
+
+template <typename T> using PoolUnique = std::unique_ptr<T, PoolDeleter<T>>;
+
+// 用法与std::shared_ptr相同，单独的类型只是为了让Queue区分池化模式
+template <typename T> class PoolShared : public std::shared_ptr<T> {
+public:
+  PoolShared() = default;
+  PoolShared(std::nullptr_t) {}
+  PoolShared(std::shared_ptr<T> &&ptr) : std::shared_ptr<T>(std::move(ptr)) {}
+};
+
+template <typename T, class... Args>
+PoolUnique<T> make_pool_unique(Args &&...args) {
+  void *memory = detail::Pool<sizeof(T), alignof(T)>::allocate();
+  try {
+    return PoolUnique<T>(new (memory) T(std::forward<Args>(args)...));
+  } catch (...) {
+    detail::Pool<sizeof(T), alignof(T)>::deallocate(memory);
+    throw;
+  }
+}
+
+template <typename T, class... Args>
+PoolShared<T> make_pool_shared(Args &&...args) {
+  return std::allocate_shared<T>(PoolAllocator<T>(),
+                                 std::forward<Args>(args)...);
+}
+}; // namespace ThreadSafe
@@ -1,22 +1,79 @@
 #pragma once
 
+#include "coro_ts.hpp"
+#include "detail_ts.hpp"
+#include "event_ts.hpp"
+#include "heap_ts.hpp"
+#include "select_ts.hpp"
+#include "stats_ts.hpp"
+
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace ThreadSafe {
 
-template <typename T, template <typename> class SmartPtr> class Queue {
-  static_assert(std::is_same_v<SmartPtr<T>, std::unique_ptr<T>> ||
-                    std::is_same_v<SmartPtr<T>, std::shared_ptr<T>>,
-                "SmartPtr must be either std::unique_ptr or std::shared_ptr");
+template <typename T, template <typename> class SmartPtr, class Cmp = void,
+          class Wait = Block, class Stats = NoStats>
+class alignas(detail::cache_line) Queue {
+  static_assert(detail::is_storage_v<T, SmartPtr>,
+                "SmartPtr must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+  // 后端标签只有NoStats的特化，带Stats时会落到这里被当成比较器
+  static_assert(!detail::is_backend_tag_v<Cmp> ||
+                    std::is_same_v<Stats, NoStats>,
+                "Ring/Segmented backends do not support Stats, "
+                "use NoStats or a mutex Queue");
 
 public:
-  void push(const T &value);
-  void push(T &&value);
+  using container_type =
+      std::conditional_t<std::is_void_v<Cmp>,
+                         std::queue<detail::stored_t<T, SmartPtr>>,
+                         detail::Heap<T, SmartPtr, Cmp>>;
+
+  explicit Queue(size_t capacity = 0);
+
+  // close()之后所有push都返回false
+  bool push(const T &value);
+  bool push(T &&value);
+  bool push_try(const T &value);
+  bool push_try(T &&value);
+
+  template <class Rep, class Period>
+  bool push_for(const T &value,
+                const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  bool push_for(T &&value, const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  bool push_until(const T &value,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+  template <class Clock, class Duration>
+  bool push_until(T &&value,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  template <class... Args> bool emplace(Args &&...args);
+  template <class... Args> bool try_emplace(Args &&...args);
+
+  // 等待空位期间被close()时返回false，剩下的元素不再放入
+  template <class InputIt> bool push_bulk(InputIt first, InputIt last);
+
+  class ProducerHandle;
+
+  // 供一个生产者线程独占使用的缓冲句柄：push先放进句柄自己的缓冲区，
+  // 攒够batch个、距缓冲区里第一个元素超过max_latency或调用flush()时
+  // 一次加锁全部放入队列。max_latency为0时只按batch和flush()发布
+  ProducerHandle producer(size_t batch = 64,
+                          std::chrono::steady_clock::duration max_latency =
+                              std::chrono::microseconds(100));
 
   SmartPtr<T> pop_must();
   SmartPtr<T> pop_try();
@@ -28,86 +85,1038 @@ public:
   SmartPtr<T>
   pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
 
+  template <class OutputIt> size_t pop_bulk(OutputIt out, size_t max);
+
+  template <class OutputIt, class Rep, class Period>
+  size_t pop_bulk_for(OutputIt out, size_t max,
+                      const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class OutputIt, class Clock, class Duration>
+  size_t
+  pop_bulk_until(OutputIt out, size_t max,
+                 const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // 加锁期间只交换容器，取走当前全部元素；队列为空时返回空容器
+  container_type pop_all();
+
+  template <class Rep, class Period>
+  container_type
+  pop_all_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  // 等到至少有一个元素再全部取走，超时或关闭后取空时返回空容器
+  template <class Clock, class Duration>
+  container_type
+  pop_all_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+#ifdef THREAD_SAFE_COROUTINES
+  template <class Executor> class PopAwaiter;
+
+  // co_await queue.co_pop(executor)：队列非空时不挂起直接取出；否则把协程挂在
+  // 等待链表上，由push在锁内直接交付元素，解锁后调用executor(handle)恢复。
+  // close()之后以空值恢复。挂起的协程只能由push或close()唤醒，队列必须比它们活得久
+  template <class Executor = InlineExecutor>
+  PopAwaiter<Executor> co_pop(Executor executor = Executor());
+#endif
+
+  // close()之后push失败，阻塞的pop在队列取空后返回空值(pop_bulk_*返回0)
+  void close();
+  bool closed() const;
+  // 一次加锁换出整个容器，再在锁外依次写入out，返回个数
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
   size_t size() const;
+  size_t capacity() const;
+
+  // 不加锁的近似值：读取push/pop维护的原子计数，不与其它操作线性化
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+#ifdef THREAD_SAFE_EVENTFD
+  // 第一次调用时创建eventfd，之后返回同一个fd，随队列析构关闭。
+  // fd可读表示队列非空或已关闭，可以和socket一起交给epoll；
+  // 读到可读后用pop_try / pop_all取到空为止，最后一个元素被取走时fd恢复不可读。
+  // 只在空和非空之间切换时读写fd，不调用native_handle()的队列没有这部分开销
+  int native_handle();
+#endif
+
+  // Stats为Counters时可以随时调用stats().snapshot()，不加锁
+  const Stats &stats() const;
 
 private:
-  std::queue<SmartPtr<T>> _queue;
-  mutable std::mutex _lock;
-  std::condition_variable _cv;
+  friend struct detail::Select;
+
+  using co_waiter = detail::CoWaiter<SmartPtr<T>>;
+
+  co_waiter *hand_off();
+  static void resume(co_waiter *chain);
+
+  std::unique_lock<std::mutex> acquire();
+  void linked(size_t count);
+  void unlinked(size_t count);
+  void signal_selectors();
+
+  template <class F, class... Args>
+  static decltype(auto) prepare(F &&f, Args &&...args);
+
+  template <class Clock, class Duration, class... Args>
+  bool
+  emplace_until(const std::chrono::time_point<Clock, Duration> &timeout_time,
+                Args &&...args);
+
+  template <class... Args>
+  void link(std::unique_lock<std::mutex> &lock, Args &&...args);
+  template <class It> bool link_bulk(It first, It last);
+  void notify(std::condition_variable &cv, size_t count);
+
+  bool full() const;
+  bool wait_not_full(std::unique_lock<std::mutex> &lock);
+  template <class Clock, class Duration>
+  bool wait_not_full_until(
+      std::unique_lock<std::mutex> &lock,
+      const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  template <class Expired>
+  bool spin_not_empty(std::unique_lock<std::mutex> &lock, Expired expired);
+  bool wait_not_empty(std::unique_lock<std::mutex> &lock);
+  template <class Clock, class Duration>
+  bool wait_not_empty_until(
+      std::unique_lock<std::mutex> &lock,
+      const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  SmartPtr<T> take(std::unique_lock<std::mutex> &lock);
+  void take_all(std::unique_lock<std::mutex> &lock, container_type &out);
+  template <class OutputIt>
+  size_t take_bulk(std::unique_lock<std::mutex> &lock, OutputIt &out,
+                   size_t max);
+
+  // 布局按访问者分组，每组独占缓存行；类本身按cache_line对齐，
+  // 数组里相邻的队列也不会共享缓存行。
+  // 持锁访问的状态：锁和它保护的数据放在一起，拿到锁的线程一次带走
+  alignas(detail::cache_line) mutable std::mutex _lock;
+  container_type _queue;
+  size_t _capacity;
+  size_t _waiters = 0;
+  size_t _push_waiters = 0;
+  co_waiter *_co_head = nullptr;
+  co_waiter *_co_tail = nullptr;
+  detail::Readiness _ready;
+  // 正在select这个队列的调用，见select_ts.hpp
+  detail::SelectWaiter *_selectors = nullptr;
+  // 消费者睡眠、生产者通知
+  alignas(detail::cache_line) std::condition_variable _cv;
+  // 生产者睡眠、消费者通知
+  alignas(detail::cache_line) std::condition_variable _not_full;
+  // 只在持锁时写入，供size_approx和自旋阶段不加锁地读取；
+  // 自旋的消费者反复读这一行，不能和_lock在一起
+  alignas(detail::cache_line) std::atomic<size_t> _count{0};
+  std::atomic<bool> _closed{false};
+  Wait _wait;
+  Stats _stats;
 };
 
-template <typename T, template <typename> class SmartPtr>
-size_t Queue<T, SmartPtr>::size() const {
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+Queue<T, SmartPtr, Cmp, Wait, Stats>::Queue(size_t capacity)
+    : _capacity(capacity) {}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::size() const {
   std::lock_guard<std::mutex> lock(_lock);
   return _queue.size();
 }
 
-template <typename T, template <typename> class SmartPtr>
-void Queue<T, SmartPtr>::push(const T &value) {
-  std::lock_guard<std::mutex> lock(_lock);
-  if constexpr (std::is_same_v<SmartPtr<T>, std::unique_ptr<T>>) {
-    _queue.push(std::make_unique<T>(value));
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::size_approx() const {
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::empty_approx() const {
+  return size_approx() == 0;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::capacity() const {
+  return _capacity;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::full() const {
+  return _capacity != 0 && _queue.size() >= _capacity;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push(T &&value) {
+  return emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push_try(const T &value) {
+  return try_emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push_try(T &&value) {
+  return try_emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Rep, class Period>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push_for(
+    const T &value, const std::chrono::duration<Rep, Period> &timeout) {
+  return emplace_until(std::chrono::steady_clock::now() + timeout, value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Rep, class Period>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push_for(
+    T &&value, const std::chrono::duration<Rep, Period> &timeout) {
+  return emplace_until(std::chrono::steady_clock::now() + timeout,
+                       std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Clock, class Duration>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push_until(
+    const T &value,
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return emplace_until(timeout_time, value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Clock, class Duration>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push_until(
+    T &&value, const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return emplace_until(timeout_time, std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class F, class... Args>
+decltype(auto)
+Queue<T, SmartPtr, Cmp, Wait, Stats>::prepare(F &&f, Args &&...args) {
+  // 智能指针模式在加锁之前完成分配，Inline模式在容器内原地构造
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    return f(std::forward<Args>(args)...);
   } else {
-    _queue.push(std::make_shared<T>(value));
+    return f(detail::make_smart<T, SmartPtr>(std::forward<Args>(args)...));
   }
-  _cv.notify_one();
 }
 
-template <typename T, template <typename> class SmartPtr>
-void Queue<T, SmartPtr>::push(T &&value) {
-  std::lock_guard<std::mutex> lock(_lock);
-  if constexpr (std::is_same_v<SmartPtr<T>, std::unique_ptr<T>>) {
-    _queue.push(std::make_unique<T>(std::forward<T>(value)));
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class... Args>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::emplace(Args &&...args) {
+  return prepare(
+      [this](auto &&...node) {
+        std::unique_lock<std::mutex> lock = acquire();
+        if (!wait_not_full(lock)) {
+          return false;
+        }
+        link(lock, std::forward<decltype(node)>(node)...);
+        return true;
+      },
+      std::forward<Args>(args)...);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class... Args>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::try_emplace(Args &&...args) {
+  return prepare(
+      [this](auto &&...node) {
+        std::unique_lock<std::mutex> lock = acquire();
+        if (closed() || full()) {
+          return false;
+        }
+        link(lock, std::forward<decltype(node)>(node)...);
+        return true;
+      },
+      std::forward<Args>(args)...);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Clock, class Duration, class... Args>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::emplace_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time,
+    Args &&...args) {
+  return prepare(
+      [&](auto &&...node) {
+        std::unique_lock<std::mutex> lock = acquire();
+        if (!wait_not_full_until(lock, timeout_time)) {
+          return false;
+        }
+        link(lock, std::forward<decltype(node)>(node)...);
+        return true;
+      },
+      std::forward<Args>(args)...);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class... Args>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::link(
+    std::unique_lock<std::mutex> &lock, Args &&...args) {
+  _queue.emplace(std::forward<Args>(args)...);
+  linked(1);
+  co_waiter *ready = hand_off();
+  bool wake = _waiters > 0 && !_queue.empty();
+  lock.unlock();
+  if (wake) {
+    _cv.notify_one();
+  }
+  _stats.enqueued(1);
+  resume(ready);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::notify(
+    std::condition_variable &cv, size_t count) {
+  if (count == 1) {
+    cv.notify_one();
+  } else if (count > 1) {
+    cv.notify_all();
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class InputIt>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::push_bulk(InputIt first,
+                                                     InputIt last) {
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    return link_bulk(first, last);
   } else {
-    _queue.push(std::make_shared<T>(std::forward<T>(value)));
+    std::vector<SmartPtr<T>> nodes;
+    for (; first != last; ++first) {
+      nodes.push_back(detail::make_smart<T, SmartPtr>(*first));
+    }
+    return link_bulk(std::make_move_iterator(nodes.begin()),
+                     std::make_move_iterator(nodes.end()));
   }
-  _cv.notify_one();
 }
 
-template <typename T, template <typename> class SmartPtr>
-SmartPtr<T> Queue<T, SmartPtr>::pop_must() {
-  std::unique_lock<std::mutex> lock(_lock);
-  _cv.wait(lock, [this]() { return !_queue.empty(); });
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class It>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::link_bulk(It first, It last) {
+  std::unique_lock<std::mutex> lock = acquire();
+  if (closed()) {
+    return false;
+  }
+  for (;;) {
+    size_t from = _queue.size();
+    for (; first != last && !full(); ++first) {
+      if constexpr (std::is_void_v<Cmp>) {
+        _queue.emplace(*first);
+      } else {
+        _queue.append(*first);
+      }
+    }
+    if constexpr (!std::is_void_v<Cmp>) {
+      _queue.heapify_from(from);
+    }
+    size_t count = _queue.size() - from;
+    linked(count);
+    co_waiter *ready = hand_off();
+    bool wake = _waiters > 0 && !_queue.empty();
+    if (first == last) {
+      lock.unlock();
+      if (wake) {
+        notify(_cv, count);
+      }
+      _stats.enqueued(count);
+      resume(ready);
+      return true;
+    }
+    // 容量已满：先唤醒消费者腾出空间，再等待
+    if (wake) {
+      notify(_cv, count);
+    }
+    _stats.enqueued(count);
+    if (ready != nullptr) {
+      // 协程可能在本线程上恢复，不能持锁
+      lock.unlock();
+      resume(ready);
+      lock.lock();
+    }
+    if (!wait_not_full(lock)) {
+      return false;
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::wait_not_full(
+    std::unique_lock<std::mutex> &lock) {
+  if (_capacity == 0 || closed()) {
+    return !closed();
+  }
+  ++_push_waiters;
+  _not_full.wait(lock, [this]() { return !full() || closed(); });
+  --_push_waiters;
+  return !closed();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Clock, class Duration>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::wait_not_full_until(
+    std::unique_lock<std::mutex> &lock,
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  if (_capacity == 0 || closed()) {
+    return !closed();
+  }
+  ++_push_waiters;
+  _not_full.wait_until(lock, timeout_time,
+                       [this]() { return !full() || closed(); });
+  --_push_waiters;
+  return !full() && !closed();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Expired>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::spin_not_empty(
+    std::unique_lock<std::mutex> &lock, Expired expired) {
+  if (!_queue.empty()) {
+    return true;
+  }
+  if constexpr (std::is_same_v<Wait, Block>) {
+    return false;
+  } else {
+    // 自旋时放开锁，只读_count；看到非空后重新加锁确认，被抢走就继续自旋
+    for (;;) {
+      lock.unlock();
+      bool hit = _wait.spin(
+          [this]() {
+            return _count.load(std::memory_order_relaxed) != 0 ||
+                   _closed.load(std::memory_order_relaxed);
+          },
+          expired);
+      lock.lock();
+      if (!_queue.empty()) {
+        return true;
+      }
+      if (!hit || closed()) {
+        return false;
+      }
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::wait_not_empty(
+    std::unique_lock<std::mutex> &lock) {
+  if (!_queue.empty() || closed()) {
+    return !_queue.empty();
+  }
+  auto start = Stats::now();
+  if (!spin_not_empty(lock, []() { return false; })) {
+    ++_waiters;
+    _cv.wait(lock, [this]() { return !_queue.empty() || closed(); });
+    --_waiters;
+  }
+  _stats.blocked(start);
+  return !_queue.empty();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Clock, class Duration>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::wait_not_empty_until(
+    std::unique_lock<std::mutex> &lock,
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  if (!_queue.empty() || closed()) {
+    return !_queue.empty();
+  }
+  auto start = Stats::now();
+  if (!spin_not_empty(lock, [&]() { return Clock::now() >= timeout_time; })) {
+    ++_waiters;
+    _cv.wait_until(lock, timeout_time,
+                   [this]() { return !_queue.empty() || closed(); });
+    --_waiters;
+  }
+  _stats.blocked(start);
+  return !_queue.empty();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+SmartPtr<T> Queue<T, SmartPtr, Cmp, Wait, Stats>::take(
+    std::unique_lock<std::mutex> &lock) {
   SmartPtr<T> value = std::move(_queue.front());
   _queue.pop();
+  unlinked(1);
+  bool wake = _push_waiters > 0;
+  lock.unlock();
+  if (wake) {
+    _not_full.notify_one();
+  }
+  _stats.dequeued(1);
   return value;
 }
 
-template <typename T, template <typename> class SmartPtr>
-SmartPtr<T> Queue<T, SmartPtr>::pop_try() {
-  std::lock_guard<std::mutex> lock(_lock);
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+SmartPtr<T> Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_must() {
+  std::unique_lock<std::mutex> lock = acquire();
+  if (!wait_not_empty(lock)) {
+    return {};
+  }
+  return take(lock);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+SmartPtr<T> Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_try() {
+  std::unique_lock<std::mutex> lock = acquire();
   if (_queue.empty()) {
-    return nullptr;
+    return {};
   }
-  SmartPtr<T> value = std::move(_queue.front());
-  _queue.pop();
-  return value;
+  return take(lock);
 }
 
-template <typename T, template <typename> class SmartPtr>
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
 template <class Rep, class Period>
-SmartPtr<T>
-Queue<T, SmartPtr>::pop_for(const std::chrono::duration<Rep, Period> &timeout) {
-  std::unique_lock<std::mutex> lock(_lock);
-  if (_cv.wait_for(lock, timeout, [this]() { return !_queue.empty(); })) {
-    SmartPtr<T> value = std::move(_queue.front());
+SmartPtr<T> Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Clock, class Duration>
+SmartPtr<T> Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  std::unique_lock<std::mutex> lock = acquire();
+  if (wait_not_empty_until(lock, timeout_time)) {
+    return take(lock);
+  }
+  return {};
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class OutputIt>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::take_bulk(
+    std::unique_lock<std::mutex> &lock, OutputIt &out, size_t max) {
+  size_t count = 0;
+  for (; count < max && !_queue.empty(); ++count) {
+    *out = std::move(_queue.front());
+    ++out;
     _queue.pop();
-    return value;
   }
-  return nullptr;
+  unlinked(count);
+  bool wake = _push_waiters > 0;
+  lock.unlock();
+  if (wake) {
+    notify(_not_full, count);
+  }
+  _stats.dequeued(count);
+  return count;
 }
 
-template <typename T, template <typename> class SmartPtr>
-template <class Clock, class Duration>
-SmartPtr<T> Queue<T, SmartPtr>::pop_until(
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class OutputIt>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_bulk(OutputIt out,
+                                                     size_t max) {
+  std::unique_lock<std::mutex> lock = acquire();
+  return take_bulk(lock, out, max);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class OutputIt, class Rep, class Period>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_bulk_for(
+    OutputIt out, size_t max,
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_bulk_until(out, max, std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class OutputIt, class Clock, class Duration>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_bulk_until(
+    OutputIt out, size_t max,
     const std::chrono::time_point<Clock, Duration> &timeout_time) {
-  std::unique_lock<std::mutex> lock(_lock);
-  if (_cv.wait_until(lock, timeout_time,
-                     [this]() { return !_queue.empty(); })) {
-    SmartPtr<T> value = std::move(_queue.front());
+  std::unique_lock<std::mutex> lock = acquire();
+  if (wait_not_empty_until(lock, timeout_time)) {
+    return take_bulk(lock, out, max);
+  }
+  return 0;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+const Stats &Queue<T, SmartPtr, Cmp, Wait, Stats>::stats() const {
+  return _stats;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+std::unique_lock<std::mutex> Queue<T, SmartPtr, Cmp, Wait, Stats>::acquire() {
+  if constexpr (Stats::enabled) {
+    std::unique_lock<std::mutex> lock(_lock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      _stats.contended();
+      lock.lock();
+    }
+    return lock;
+  } else {
+    return std::unique_lock<std::mutex>(_lock);
+  }
+}
+
+// 持锁调用：更新无锁可读的元素数、eventfd的可读状态，
+// 以及统计里的高水位和入队时间
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::linked(size_t count) {
+  _count.store(_queue.size(), std::memory_order_relaxed);
+  if (count != 0) {
+    _ready.raise();
+    signal_selectors();
+  }
+  _stats.resized(_queue.size());
+  if constexpr (std::is_void_v<Cmp>) {
+    _stats.stamped(count);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::unlinked(size_t count) {
+  _count.store(_queue.size(), std::memory_order_relaxed);
+  // 关闭之后fd一直保持可读
+  if (_queue.empty() && !closed()) {
+    _ready.clear();
+  }
+  if constexpr (std::is_void_v<Cmp>) {
+    _stats.aged(count);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::signal_selectors() {
+  for (detail::SelectWaiter *waiter = _selectors; waiter != nullptr;
+       waiter = waiter->next) {
+    waiter->selector->fire();
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::close() {
+  co_waiter *waiters;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _closed.store(true, std::memory_order_relaxed);
+    _ready.raise();
+    signal_selectors();
+    // 队列里仍有元素时不会有协程在等待，剩下的都以空值恢复
+    waiters = _co_head;
+    _co_head = _co_tail = nullptr;
+  }
+  _cv.notify_all();
+  _not_full.notify_all();
+  resume(waiters);
+}
+
+#ifdef THREAD_SAFE_EVENTFD
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+int Queue<T, SmartPtr, Cmp, Wait, Stats>::native_handle() {
+  std::lock_guard<std::mutex> lock(_lock);
+  return _ready.open(!_queue.empty() || closed());
+}
+#endif
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::closed() const {
+  return _closed.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class OutputIt>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::drain_into(OutputIt out) {
+  container_type drained = pop_all();
+  size_t count = drained.size();
+  for (; !drained.empty(); drained.pop()) {
+    *out = std::move(drained.front());
+    ++out;
+  }
+  return count;
+}
+
+// out是锁外构造好的空容器，交换后在锁外析构原来的空容器
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::take_all(
+    std::unique_lock<std::mutex> &lock, container_type &out) {
+  out.swap(_queue);
+  size_t count = out.size();
+  unlinked(count);
+  bool wake = _push_waiters > 0;
+  lock.unlock();
+  if (wake) {
+    notify(_not_full, count);
+  }
+  _stats.dequeued(count);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+auto Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_all() -> container_type {
+  container_type all;
+  std::unique_lock<std::mutex> lock = acquire();
+  take_all(lock, all);
+  return all;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Rep, class Period>
+auto Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_all_for(
+    const std::chrono::duration<Rep, Period> &timeout) -> container_type {
+  return pop_all_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Clock, class Duration>
+auto Queue<T, SmartPtr, Cmp, Wait, Stats>::pop_all_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time)
+    -> container_type {
+  container_type all;
+  std::unique_lock<std::mutex> lock = acquire();
+  if (wait_not_empty_until(lock, timeout_time)) {
+    take_all(lock, all);
+  }
+  return all;
+}
+
+// 持锁调用：把队首元素依次交给等待的协程，返回需要在解锁后恢复的节点
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+auto Queue<T, SmartPtr, Cmp, Wait, Stats>::hand_off() -> co_waiter * {
+  if (_co_head == nullptr) {
+    return nullptr;
+  }
+  co_waiter *chain = nullptr;
+  co_waiter **last = &chain;
+  size_t count = 0;
+  while (_co_head != nullptr && !_queue.empty()) {
+    co_waiter *waiter = _co_head;
+    _co_head = waiter->next;
+    if constexpr (detail::is_inline_v<T, SmartPtr>) {
+      waiter->value.emplace(std::move(_queue.front()));
+    } else {
+      waiter->value = std::move(_queue.front());
+    }
     _queue.pop();
-    return value;
+    waiter->next = nullptr;
+    *last = waiter;
+    last = &waiter->next;
+    ++count;
+  }
+  if (_co_head == nullptr) {
+    _co_tail = nullptr;
   }
-  return nullptr;
+  unlinked(count);
+  _stats.dequeued(count);
+  return chain;
 }
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::resume(co_waiter *chain) {
+  while (chain != nullptr) {
+    co_waiter *next = chain->next;
+    chain->wake(chain);
+    chain = next;
+  }
+}
+
+#ifdef THREAD_SAFE_COROUTINES
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Executor>
+class Queue<T, SmartPtr, Cmp, Wait, Stats>::PopAwaiter : private co_waiter {
+public:
+  PopAwaiter(Queue &queue, Executor executor);
+
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle);
+  SmartPtr<T> await_resume();
+
+private:
+  static void dispatch(co_waiter *waiter);
+
+  Queue &_queue;
+  Executor _executor;
+  std::coroutine_handle<> _handle;
+};
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Executor>
+Queue<T, SmartPtr, Cmp, Wait, Stats>::PopAwaiter<Executor>::PopAwaiter(
+    Queue &queue, Executor executor)
+    : _queue(queue), _executor(std::move(executor)) {}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Executor>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::PopAwaiter<Executor>::await_suspend(
+    std::coroutine_handle<> handle) {
+  _handle = handle;
+  this->wake = &PopAwaiter::dispatch;
+  std::unique_lock<std::mutex> lock = _queue.acquire();
+  if (!_queue._queue.empty()) {
+    SmartPtr<T> value = _queue.take(lock);
+    if constexpr (detail::is_inline_v<T, SmartPtr>) {
+      this->value.emplace(std::move(*value));
+    } else {
+      this->value = std::move(value);
+    }
+    return false;
+  }
+  if (_queue.closed()) {
+    return false;
+  }
+  if (_queue._co_tail != nullptr) {
+    _queue._co_tail->next = this;
+  } else {
+    _queue._co_head = this;
+  }
+  _queue._co_tail = this;
+  // 解锁之后本对象可能已经在别的线程上被恢复并销毁，不能再访问成员
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Executor>
+SmartPtr<T> Queue<T, SmartPtr, Cmp, Wait, Stats>::PopAwaiter<
+    Executor>::await_resume() {
+  return std::move(this->value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Executor>
+void Queue<T, SmartPtr, Cmp, Wait, Stats>::PopAwaiter<Executor>::dispatch(
+    co_waiter *waiter) {
+  PopAwaiter *self = static_cast<PopAwaiter *>(waiter);
+  self->_executor(self->_handle);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class Executor>
+auto Queue<T, SmartPtr, Cmp, Wait, Stats>::co_pop(Executor executor)
+    -> PopAwaiter<Executor> {
+  return PopAwaiter<Executor>(*this, std::move(executor));
+}
+#endif
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+class Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle {
+public:
+  using clock = std::chrono::steady_clock;
+
+  ProducerHandle(Queue &queue, size_t batch, clock::duration max_latency);
+  // 析构时发布缓冲区里剩下的元素
+  ~ProducerHandle();
+
+  ProducerHandle(ProducerHandle &&other) noexcept;
+  ProducerHandle &operator=(ProducerHandle &&other) noexcept;
+
+  // 只有触发发布时才加锁；close()之后返回false，
+  // 发布时发现队列已关闭，缓冲区里的元素全部丢弃。
+  // 被移走的句柄不再关联队列，push / emplace / flush / poll都返回false
+  bool push(const T &value);
+  bool push(T &&value);
+  template <class... Args> bool emplace(Args &&...args);
+
+  // 立即发布缓冲区里的元素
+  bool flush();
+  // 缓冲区里的元素超过max_latency时发布；生产者空闲时在自己的循环里调用，
+  // 句柄没有后台线程，不调用push / poll时延迟不受max_latency约束
+  bool poll();
+
+  size_t buffered() const;
+
+private:
+  Queue *_queue;
+  size_t _batch;
+  clock::duration _max_latency;
+  clock::time_point _deadline;
+  std::vector<detail::stored_t<T, SmartPtr>> _buffer;
+};
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::ProducerHandle(
+    Queue &queue, size_t batch, clock::duration max_latency)
+    : _queue(&queue), _batch(batch > 0 ? batch : 1),
+      _max_latency(max_latency) {
+  _buffer.reserve(_batch);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::~ProducerHandle() {
+  if (_queue != nullptr) {
+    flush();
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::ProducerHandle(
+    ProducerHandle &&other) noexcept
+    : _queue(other._queue), _batch(other._batch),
+      _max_latency(other._max_latency), _deadline(other._deadline),
+      _buffer(std::move(other._buffer)) {
+  other._queue = nullptr;
+  other._buffer.clear();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+auto Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::operator=(
+    ProducerHandle &&other) noexcept -> ProducerHandle & {
+  if (this != &other) {
+    if (_queue != nullptr) {
+      flush();
+    }
+    _queue = other._queue;
+    _batch = other._batch;
+    _max_latency = other._max_latency;
+    _deadline = other._deadline;
+    _buffer = std::move(other._buffer);
+    other._queue = nullptr;
+    other._buffer.clear();
+  }
+  return *this;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::push(
+    const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::push(T &&value) {
+  return emplace(std::move(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+template <class... Args>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::emplace(
+    Args &&...args) {
+  if (_queue == nullptr || _queue->closed()) {
+    return false;
+  }
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    _buffer.emplace_back(std::forward<Args>(args)...);
+  } else {
+    _buffer.push_back(
+        detail::make_smart<T, SmartPtr>(std::forward<Args>(args)...));
+  }
+  if (_buffer.size() >= _batch) {
+    return flush();
+  }
+  if (_max_latency.count() > 0) {
+    clock::time_point now = clock::now();
+    if (_buffer.size() == 1) {
+      _deadline = now + _max_latency;
+    } else if (now >= _deadline) {
+      return flush();
+    }
+  }
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::flush() {
+  if (_queue == nullptr) {
+    return false;
+  }
+  if (_buffer.empty()) {
+    return !_queue->closed();
+  }
+  bool ok = _queue->link_bulk(std::make_move_iterator(_buffer.begin()),
+                              std::make_move_iterator(_buffer.end()));
+  _buffer.clear();
+  return ok;
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+bool Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::poll() {
+  if (_queue == nullptr) {
+    return false;
+  }
+  if (_buffer.empty() || _max_latency.count() <= 0 ||
+      clock::now() < _deadline) {
+    return !_queue->closed();
+  }
+  return flush();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+size_t Queue<T, SmartPtr, Cmp, Wait, Stats>::ProducerHandle::buffered() const {
+  return _buffer.size();
+}
+
+template <typename T, template <typename> class SmartPtr, class Cmp,
+          class Wait, class Stats>
+auto Queue<T, SmartPtr, Cmp, Wait, Stats>::producer(
+    size_t batch, std::chrono::steady_clock::duration max_latency)
+    -> ProducerHandle {
+  return ProducerHandle(*this, batch, max_latency);
+}
+
+template <typename T, class Cmp = void>
+using SharedQueue = Queue<T, std::shared_ptr, Cmp>;
+
+template <typename T, class Cmp = void>
+using UniqueQueue = Queue<T, std::unique_ptr, Cmp>;
 }; // namespace ThreadSafe
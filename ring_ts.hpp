@@ -0,0 +1,420 @@
+#pragma once
+
+#include "detail_ts.hpp"
+#include "queue_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace ThreadSafe {
+
+template <size_t Capacity> struct Ring {};
+
+namespace detail {
+template <size_t Capacity>
+struct is_backend_tag<Ring<Capacity>> : std::true_type {};
+} // namespace detail
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait = Block>
+class alignas(detail::cache_line) RingQueue {
+  static_assert(detail::is_storage_v<T, SmartPtr>,
+                "SmartPtr must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+public:
+  RingQueue();
+
+  // close()之后所有push都返回false
+  bool push(const T &value);
+  bool push(T &&value);
+  bool push_try(const T &value);
+  bool push_try(T &&value);
+
+  template <class Rep, class Period>
+  bool push_for(const T &value,
+                const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  bool push_for(T &&value, const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  bool push_until(const T &value,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+  template <class Clock, class Duration>
+  bool push_until(T &&value,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  template <class... Args> bool emplace(Args &&...args);
+  template <class... Args> bool try_emplace(Args &&...args);
+
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // close()之后push失败，阻塞的pop在取空后返回空值；
+  // 与close()并发的push可能成功，这些元素仍可由pop_try / drain_into取出
+  void close();
+  bool closed() const;
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  // 两个下标各自读取，size()本身就是近似值；size_approx()与其相同，
+  // 便于和Queue互换
+  size_t size() const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    SmartPtr<T> value;
+  };
+
+  template <class Clock, class Duration, class... Args>
+  bool
+  emplace_until(const std::chrono::time_point<Clock, Duration> &timeout_time,
+                Args &&...args);
+
+  template <class F, class... Args>
+  static decltype(auto) with_prepared(F &&f, Args &&...args);
+
+  template <class... Args> bool enqueue(Args &&...args);
+  bool dequeue(SmartPtr<T> &value);
+
+  // 只读的槽位指针和很少写入的_closed，所有线程共享
+  std::unique_ptr<Slot[]> _slots;
+  std::atomic<bool> _closed{false};
+  // 生产者之间竞争的下标和消费者之间竞争的下标各占一行
+  alignas(detail::cache_line) std::atomic<size_t> _enqueue_pos{0};
+  alignas(detail::cache_line) std::atomic<size_t> _dequeue_pos{0};
+  // 消费者在_not_empty上睡眠，生产者在_not_full上睡眠
+  alignas(detail::cache_line) detail::Parking<Wait> _not_empty;
+  alignas(detail::cache_line) detail::Parking<Wait> _not_full;
+};
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+class Queue<T, SmartPtr, Ring<Capacity>, Wait, NoStats>
+    : public RingQueue<T, SmartPtr, Capacity, Wait> {};
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+RingQueue<T, SmartPtr, Capacity, Wait>::RingQueue()
+    : _slots(new Slot[Capacity]) {
+  for (size_t i = 0; i < Capacity; ++i) {
+    _slots[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class F, class... Args>
+decltype(auto)
+RingQueue<T, SmartPtr, Capacity, Wait>::with_prepared(F &&f, Args &&...args) {
+  // 槽位一旦被占用就必须发布，所以可能抛异常的构造放在占用之前完成
+  if constexpr (!detail::is_inline_v<T, SmartPtr>) {
+    SmartPtr<T> ptr =
+        detail::make_smart<T, SmartPtr>(std::forward<Args>(args)...);
+    return f(std::move(ptr));
+  } else if constexpr (std::is_nothrow_constructible_v<T, Args &&...>) {
+    return f(std::forward<Args>(args)...);
+  } else {
+    T value(std::forward<Args>(args)...);
+    return f(std::move(value));
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class... Args>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::enqueue(Args &&...args) {
+  size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot &slot = _slots[pos & (Capacity - 1)];
+    size_t seq = slot.seq.load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (_enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        if constexpr (detail::is_inline_v<T, SmartPtr>) {
+          slot.value.emplace(std::forward<Args>(args)...);
+        } else {
+          slot.value = SmartPtr<T>(std::forward<Args>(args)...);
+        }
+        slot.seq.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = _enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::dequeue(SmartPtr<T> &value) {
+  size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot &slot = _slots[pos & (Capacity - 1)];
+    size_t seq = slot.seq.load(std::memory_order_acquire);
+    intptr_t diff =
+        static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+    if (diff == 0) {
+      if (_dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        value = std::move(slot.value);
+        slot.value.reset();
+        slot.seq.store(pos + Capacity, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = _dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+size_t RingQueue<T, SmartPtr, Capacity, Wait>::size() const {
+  size_t head = _dequeue_pos.load(std::memory_order_relaxed);
+  size_t tail = _enqueue_pos.load(std::memory_order_relaxed);
+  return tail > head ? tail - head : 0;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+size_t RingQueue<T, SmartPtr, Capacity, Wait>::size_approx() const {
+  return size();
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::empty_approx() const {
+  return size() == 0;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push(T &&value) {
+  return emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push_try(const T &value) {
+  return try_emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push_try(T &&value) {
+  return try_emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Rep, class Period>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push_for(
+    const T &value, const std::chrono::duration<Rep, Period> &timeout) {
+  return emplace_until(std::chrono::steady_clock::now() + timeout, value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Rep, class Period>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push_for(
+    T &&value, const std::chrono::duration<Rep, Period> &timeout) {
+  return emplace_until(std::chrono::steady_clock::now() + timeout,
+                       std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push_until(
+    const T &value,
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return emplace_until(timeout_time, value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::push_until(
+    T &&value, const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return emplace_until(timeout_time, std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration, class... Args>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::emplace_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time,
+    Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  bool ok = with_prepared(
+      [&](auto &&...prepared) {
+        bool done = false;
+        _not_full.wait_until(
+            [&]() {
+              done = enqueue(std::forward<decltype(prepared)>(prepared)...);
+              return done || closed();
+            },
+            timeout_time);
+        return done;
+      },
+      std::forward<Args>(args)...);
+  if (ok) {
+    _not_empty.notify_one();
+  }
+  return ok;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class... Args>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::emplace(Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  bool ok = with_prepared(
+      [this](auto &&...prepared) {
+        bool done = false;
+        _not_full.wait([&]() {
+          done = enqueue(std::forward<decltype(prepared)>(prepared)...);
+          return done || closed();
+        });
+        return done;
+      },
+      std::forward<Args>(args)...);
+  if (ok) {
+    _not_empty.notify_one();
+  }
+  return ok;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class... Args>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::try_emplace(Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  bool ok = with_prepared(
+      [this](auto &&...prepared) {
+        return enqueue(std::forward<decltype(prepared)>(prepared)...);
+      },
+      std::forward<Args>(args)...);
+  if (ok) {
+    _not_empty.notify_one();
+  }
+  return ok;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+SmartPtr<T> RingQueue<T, SmartPtr, Capacity, Wait>::pop_must() {
+  SmartPtr<T> value;
+  _not_empty.wait([&]() {
+    bool stop = closed();
+    return dequeue(value) || stop;
+  });
+  if (value) {
+    _not_full.notify_one();
+  }
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+SmartPtr<T> RingQueue<T, SmartPtr, Capacity, Wait>::pop_try() {
+  SmartPtr<T> value;
+  if (dequeue(value)) {
+    _not_full.notify_one();
+  }
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Rep, class Period>
+SmartPtr<T> RingQueue<T, SmartPtr, Capacity, Wait>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration>
+SmartPtr<T> RingQueue<T, SmartPtr, Capacity, Wait>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  SmartPtr<T> value;
+  _not_empty.wait_until(
+      [&]() {
+        bool stop = closed();
+        return dequeue(value) || stop;
+      },
+      timeout_time);
+  if (value) {
+    _not_full.notify_one();
+  }
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+void RingQueue<T, SmartPtr, Capacity, Wait>::close() {
+  _closed.store(true);
+  _not_empty.notify_all();
+  _not_full.notify_all();
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool RingQueue<T, SmartPtr, Capacity, Wait>::closed() const {
+  return _closed.load(std::memory_order_acquire);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class OutputIt>
+size_t RingQueue<T, SmartPtr, Capacity, Wait>::drain_into(OutputIt out) {
+  size_t count = 0;
+  // 与Queue一致：Inline模式写入T本身
+  for (SmartPtr<T> value; dequeue(value); ++count) {
+    if constexpr (detail::is_inline_v<T, SmartPtr>) {
+      *out = std::move(*value);
+    } else {
+      *out = std::move(value);
+    }
+    ++out;
+  }
+  if (count != 0) {
+    _not_full.notify_all();
+  }
+  return count;
+}
+}; // namespace ThreadSafe
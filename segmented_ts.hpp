@@ -0,0 +1,361 @@
+#pragma once
+
+#include "detail_ts.hpp"
+#include "hazard_ts.hpp"
+#include "queue_ts.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <utility>
+
+namespace ThreadSafe {
+
+template <size_t BlockSize = 256> struct Segmented {};
+
+namespace detail {
+template <size_t BlockSize>
+struct is_backend_tag<Segmented<BlockSize>> : std::true_type {};
+} // namespace detail
+
+// 无界无锁MPMC队列，由定长槽位块串成链表(FAA数组队列)。
+// 生产者/消费者各自对当前块的下标做fetch_add领取槽位，块用完后追加新块；
+// 消费者领到还没写入的槽位时将其作废，生产者再领取下一个。
+// 用完的块通过hazard pointer回收。
+template <typename T, template <typename> class SmartPtr,
+          size_t BlockSize = 256, class Wait = Block>
+class alignas(detail::cache_line) SegmentedQueue {
+  static_assert(detail::is_storage_v<T, SmartPtr>,
+                "SmartPtr must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+  static_assert(BlockSize >= 2, "BlockSize must be at least 2");
+
+public:
+  SegmentedQueue();
+  ~SegmentedQueue();
+
+  SegmentedQueue(const SegmentedQueue &) = delete;
+  SegmentedQueue &operator=(const SegmentedQueue &) = delete;
+
+  // 无界，close()之前总是成功；close()之后返回false
+  bool push(const T &value);
+  bool push(T &&value);
+  bool push_try(const T &value);
+  bool push_try(T &&value);
+
+  template <class... Args> bool emplace(Args &&...args);
+  template <class... Args> bool try_emplace(Args &&...args);
+
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // 语义与RingQueue相同
+  void close();
+  bool closed() const;
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  // 由首尾块的下标估算，作废的槽位也计算在内
+  size_t size() const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+private:
+  enum State : unsigned char { empty, writing, ready, taken };
+
+  struct Slot {
+    std::atomic<unsigned char> state{empty};
+    SmartPtr<T> value;
+  };
+
+  struct Node {
+    explicit Node(size_t base) : base(base) {}
+
+    const size_t base;
+    alignas(detail::cache_line) std::atomic<size_t> enqueued{0};
+    alignas(detail::cache_line) std::atomic<size_t> dequeued{0};
+    std::atomic<Node *> next{nullptr};
+    Slot slots[BlockSize];
+  };
+
+  using node_type = std::conditional_t<detail::is_inline_v<T, SmartPtr>, T,
+                                       SmartPtr<T>>;
+
+  template <class... Args> static node_type make_node(Args &&...args);
+
+  void enqueue(node_type &&node);
+  bool dequeue(SmartPtr<T> &value);
+
+  alignas(detail::cache_line) std::atomic<Node *> _head;
+  alignas(detail::cache_line) std::atomic<Node *> _tail;
+  mutable detail::Hazards<Node> _hazards;
+  alignas(detail::cache_line) std::atomic<bool> _closed{false};
+  detail::Parking<Wait> _not_empty;
+};
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+class Queue<T, SmartPtr, Segmented<BlockSize>, Wait, NoStats>
+    : public SegmentedQueue<T, SmartPtr, BlockSize, Wait> {};
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+SegmentedQueue<T, SmartPtr, BlockSize, Wait>::SegmentedQueue() {
+  Node *node = new Node(0);
+  _head.store(node, std::memory_order_relaxed);
+  _tail.store(node, std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+SegmentedQueue<T, SmartPtr, BlockSize, Wait>::~SegmentedQueue() {
+  Node *node = _head.load(std::memory_order_relaxed);
+  while (node != nullptr) {
+    Node *next = node->next.load(std::memory_order_relaxed);
+    delete node;
+    node = next;
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+template <class... Args>
+auto SegmentedQueue<T, SmartPtr, BlockSize, Wait>::make_node(Args &&...args)
+    -> node_type {
+  // 领取槽位之后不能再失败，所以构造在领取之前完成
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    return T(std::forward<Args>(args)...);
+  } else {
+    return detail::make_smart<T, SmartPtr>(std::forward<Args>(args)...);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+void SegmentedQueue<T, SmartPtr, BlockSize, Wait>::enqueue(node_type &&node) {
+  typename detail::Hazards<Node>::Guard guard(_hazards);
+  for (;;) {
+    Node *tail = guard.protect(0, _tail);
+    size_t index = tail->enqueued.fetch_add(1);
+    if (index < BlockSize) {
+      Slot &slot = tail->slots[index];
+      unsigned char state = empty;
+      if (slot.state.compare_exchange_strong(state, writing,
+                                             std::memory_order_acquire)) {
+        if constexpr (detail::is_inline_v<T, SmartPtr>) {
+          slot.value.emplace(std::move(node));
+        } else {
+          slot.value = std::move(node);
+        }
+        slot.state.store(ready, std::memory_order_release);
+        return;
+      }
+      // 槽位已被消费者作废，换下一个
+      continue;
+    }
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      Node *fresh = new Node(tail->base + BlockSize);
+      if (tail->next.compare_exchange_strong(next, fresh)) {
+        next = fresh;
+      } else {
+        delete fresh;
+      }
+    }
+    _tail.compare_exchange_strong(tail, next);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::dequeue(
+    SmartPtr<T> &value) {
+  typename detail::Hazards<Node>::Guard guard(_hazards);
+  for (;;) {
+    Node *head = guard.protect(0, _head);
+    if (head->dequeued.load() >= head->enqueued.load() &&
+        head->next.load() == nullptr) {
+      return false;
+    }
+    size_t index = head->dequeued.fetch_add(1);
+    if (index < BlockSize) {
+      Slot &slot = head->slots[index];
+      unsigned char state = slot.state.load(std::memory_order_acquire);
+      if (state == empty &&
+          slot.state.compare_exchange_strong(state, taken,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+        continue;
+      }
+      // 生产者已经占住这个槽位，只差写入
+      while (state == writing) {
+        detail::cpu_relax();
+        state = slot.state.load(std::memory_order_acquire);
+      }
+      value = std::move(slot.value);
+      slot.value.reset();
+      slot.state.store(taken, std::memory_order_relaxed);
+      return true;
+    }
+    Node *next = head->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    // 尾指针不能停在即将回收的块上
+    Node *tail = head;
+    _tail.compare_exchange_strong(tail, next);
+    if (_head.compare_exchange_strong(head, next)) {
+      _hazards.retire(head);
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+size_t SegmentedQueue<T, SmartPtr, BlockSize, Wait>::size() const {
+  typename detail::Hazards<Node>::Guard guard(_hazards);
+  Node *head = guard.protect(0, _head);
+  Node *tail = guard.protect(1, _tail);
+  size_t first =
+      head->base + std::min(head->dequeued.load(std::memory_order_relaxed),
+                            BlockSize);
+  size_t last =
+      tail->base + std::min(tail->enqueued.load(std::memory_order_relaxed),
+                            BlockSize);
+  return last > first ? last - first : 0;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+size_t SegmentedQueue<T, SmartPtr, BlockSize, Wait>::size_approx() const {
+  return size();
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::empty_approx() const {
+  return size() == 0;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::push(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::push(T &&value) {
+  return emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::push_try(const T &value) {
+  return try_emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::push_try(T &&value) {
+  return try_emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+template <class... Args>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::emplace(Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  enqueue(make_node(std::forward<Args>(args)...));
+  _not_empty.notify_one();
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+template <class... Args>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::try_emplace(
+    Args &&...args) {
+  return emplace(std::forward<Args>(args)...);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+SmartPtr<T> SegmentedQueue<T, SmartPtr, BlockSize, Wait>::pop_must() {
+  SmartPtr<T> value;
+  _not_empty.wait([&]() {
+    bool stop = closed();
+    return dequeue(value) || stop;
+  });
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+SmartPtr<T> SegmentedQueue<T, SmartPtr, BlockSize, Wait>::pop_try() {
+  SmartPtr<T> value;
+  dequeue(value);
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+template <class Rep, class Period>
+SmartPtr<T> SegmentedQueue<T, SmartPtr, BlockSize, Wait>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+template <class Clock, class Duration>
+SmartPtr<T> SegmentedQueue<T, SmartPtr, BlockSize, Wait>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  SmartPtr<T> value;
+  _not_empty.wait_until(
+      [&]() {
+        bool stop = closed();
+        return dequeue(value) || stop;
+      },
+      timeout_time);
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+void SegmentedQueue<T, SmartPtr, BlockSize, Wait>::close() {
+  _closed.store(true);
+  _not_empty.notify_all();
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+bool SegmentedQueue<T, SmartPtr, BlockSize, Wait>::closed() const {
+  return _closed.load(std::memory_order_acquire);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t BlockSize,
+          class Wait>
+template <class OutputIt>
+size_t SegmentedQueue<T, SmartPtr, BlockSize, Wait>::drain_into(OutputIt out) {
+  size_t count = 0;
+  for (SmartPtr<T> value; dequeue(value); ++count) {
+    if constexpr (detail::is_inline_v<T, SmartPtr>) {
+      *out = std::move(*value);
+    } else {
+      *out = std::move(value);
+    }
+    ++out;
+  }
+  return count;
+}
+}; // namespace ThreadSafe
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ThreadSafe {
+
+// pop_any / select的结果：index为value来自第几个队列(从0开始)，
+// 超时或全部队列关闭且取空时value为空
+template <class Value> struct Selected {
+  size_t index = 0;
+  Value value{};
+
+  explicit operator bool() const { return static_cast<bool>(value); }
+};
+
+namespace detail {
+
+// 一次select调用在所有参与的队列之间共享的通知
+class Selector {
+public:
+  void reset() { _fired.store(false); }
+  // 由队列持锁调用：节点从队列上摘下之前Selector一定还活着
+  void fire();
+
+  template <class Clock, class Duration>
+  bool
+  wait_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+  void wait();
+
+private:
+  std::atomic<bool> _fired{false};
+  Parking<> _parking;
+};
+
+inline void Selector::fire() {
+  _fired.store(true);
+  _parking.notify_one();
+}
+
+template <class Clock, class Duration>
+bool Selector::wait_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return _parking.wait_until([this]() { return _fired.load(); },
+                             timeout_time);
+}
+
+inline void Selector::wait() {
+  _parking.wait([this]() { return _fired.load(); });
+}
+
+// 挂在单个Queue上的侵入式双向链表节点，增删都在该队列的锁内
+struct SelectWaiter {
+  SelectWaiter *prev = nullptr;
+  SelectWaiter *next = nullptr;
+  Selector *selector = nullptr;
+};
+
+// Queue把挂接selector的私有成员开放给这里
+struct Select {
+  template <class Q> static void attach(Q &queue, SelectWaiter &waiter);
+  template <class Q> static void detach(Q &queue, SelectWaiter &waiter);
+
+  template <class Result, size_t I = 0, class... Queues>
+  static bool try_each(Result &result, Queues &...queues);
+
+  template <class Value, class Block, class... Queues>
+  static Selected<Value> run(Block block, Queues &...queues);
+};
+
+template <class Q> void Select::attach(Q &queue, SelectWaiter &waiter) {
+  std::lock_guard<std::mutex> lock(queue._lock);
+  waiter.prev = nullptr;
+  waiter.next = queue._selectors;
+  if (queue._selectors != nullptr) {
+    queue._selectors->prev = &waiter;
+  }
+  queue._selectors = &waiter;
+}
+
+template <class Q> void Select::detach(Q &queue, SelectWaiter &waiter) {
+  std::lock_guard<std::mutex> lock(queue._lock);
+  if (waiter.prev != nullptr) {
+    waiter.prev->next = waiter.next;
+  } else {
+    queue._selectors = waiter.next;
+  }
+  if (waiter.next != nullptr) {
+    waiter.next->prev = waiter.prev;
+  }
+}
+
+// 按参数顺序依次pop_try，排在前面的队列优先
+template <class Result, size_t I, class... Queues>
+bool Select::try_each(Result &result, Queues &...queues) {
+  if constexpr (I == sizeof...(Queues)) {
+    return false;
+  } else {
+    auto &queue = std::get<I>(std::forward_as_tuple(queues...));
+    if (auto value = queue.pop_try()) {
+      result.index = I;
+      result.value = std::move(value);
+      return true;
+    }
+    return try_each<Result, I + 1>(result, queues...);
+  }
+}
+
+// block(selector)阻塞到被通知时返回true，超时返回false
+template <class Value, class Block, class... Queues>
+Selected<Value> Select::run(Block block, Queues &...queues) {
+  Selected<Value> result;
+  if (try_each(result, queues...)) {
+    return result;
+  }
+  Selector selector;
+  SelectWaiter waiters[sizeof...(Queues)];
+  size_t i = 0;
+  ((waiters[i].selector = &selector, attach(queues, waiters[i++])), ...);
+  for (;;) {
+    // 先清除通知再检查：检查之后的push一定会再次通知
+    selector.reset();
+    // 关闭之后push都会失败，所以关闭早于这次检查时取空就确实结束了
+    bool closed = (queues.closed() && ...);
+    if (try_each(result, queues...) || closed) {
+      break;
+    }
+    if (!block(selector)) {
+      try_each(result, queues...);
+      break;
+    }
+  }
+  i = 0;
+  (detach(queues, waiters[i++]), ...);
+  return result;
+}
+} // namespace detail
+
+// 阻塞直到任一队列有元素，返回它和它所在队列的序号；多个队列同时非空时
+// 排在前面的优先。所有队列都关闭且取空时返回空值。队列必须是值类型相同、
+// SmartPtr相同的Queue(Cmp / Wait / Stats可以不同)
+template <class Q, class... Queues>
+auto select(Q &queue, Queues &...queues)
+    -> Selected<decltype(queue.pop_try())>;
+
+template <class Rep, class Period, class Q, class... Queues>
+auto pop_any_for(const std::chrono::duration<Rep, Period> &timeout, Q &queue,
+                 Queues &...queues) -> Selected<decltype(queue.pop_try())>;
+
+template <class Clock, class Duration, class Q, class... Queues>
+auto pop_any_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time, Q &queue,
+    Queues &...queues)
+    -> Selected<decltype(queue.pop_try())>;
+
+template <class Q, class... Queues>
+auto select(Q &queue, Queues &...queues)
+    -> Selected<decltype(queue.pop_try())> {
+  using Value = decltype(queue.pop_try());
+  static_assert((std::is_same_v<Value, decltype(queues.pop_try())> && ...),
+                "select requires queues with the same value type");
+  return detail::Select::run<Value>(
+      [](detail::Selector &selector) {
+        selector.wait();
+        return true;
+      },
+      queue, queues...);
+}
+
+template <class Rep, class Period, class Q, class... Queues>
+auto pop_any_for(const std::chrono::duration<Rep, Period> &timeout, Q &queue,
+                 Queues &...queues) -> Selected<decltype(queue.pop_try())> {
+  return pop_any_until(std::chrono::steady_clock::now() + timeout, queue,
+                       queues...);
+}
+
+template <class Clock, class Duration, class Q, class... Queues>
+auto pop_any_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time, Q &queue,
+    Queues &...queues)
+    -> Selected<decltype(queue.pop_try())> {
+  using Value = decltype(queue.pop_try());
+  static_assert((std::is_same_v<Value, decltype(queues.pop_try())> && ...),
+                "pop_any_until requires queues with the same value type");
+  return detail::Select::run<Value>(
+      [&](detail::Selector &selector) {
+        return selector.wait_until(timeout_time);
+      },
+      queue, queues...);
+}
+}; // namespace ThreadSafe
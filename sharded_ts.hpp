@@ -0,0 +1,208 @@
+#pragma once
+
+#include "detail_ts.hpp"
+#include "queue_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace ThreadSafe {
+
+// 由多个Queue组成：生产者放入本线程的分片，消费者先取本地分片，
+// 为空时从轮转的窃取游标开始扫描其它分片。只保证同一生产者在同一分片内的FIFO。
+// 本地分片按线程编号取模得到，局部性只对既生产又消费的线程成立；
+// 只消费的线程的本地分片是任意的，靠游标把窃取分散到各个分片
+template <typename T, template <typename> class SmartPtr, class Wait = Block>
+class alignas(detail::cache_line) ShardedQueue {
+public:
+  explicit ShardedQueue(size_t shards = std::thread::hardware_concurrency());
+
+  // close()之后返回false
+  bool push(const T &value);
+  bool push(T &&value);
+
+  template <class... Args> bool emplace(Args &&...args);
+
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // 关闭所有分片；阻塞的pop在所有分片取空后返回空值
+  void close();
+  bool closed() const;
+  // 逐个分片换出容器，每个分片只加一次锁
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  size_t size() const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+  size_t shard_count() const;
+
+private:
+  size_t local() const;
+
+  // Queue按cache_line对齐，数组里相邻的分片不共享缓存行
+  size_t _count;
+  std::unique_ptr<Queue<T, SmartPtr>[]> _shards;
+  std::atomic<bool> _closed{false};
+  // 每次窃取推进一次，多个消费者不会总从同一个分片开始扫描
+  alignas(detail::cache_line) std::atomic<size_t> _steal{0};
+  alignas(detail::cache_line) detail::Parking<Wait> _parking;
+};
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+ShardedQueue<T, SmartPtr, Wait>::ShardedQueue(size_t shards)
+    : _count(shards > 0 ? shards : 1),
+      _shards(new Queue<T, SmartPtr>[_count]) {}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t ShardedQueue<T, SmartPtr, Wait>::local() const {
+  return detail::thread_index() % _count;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t ShardedQueue<T, SmartPtr, Wait>::shard_count() const {
+  return _count;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t ShardedQueue<T, SmartPtr, Wait>::size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < _count; ++i) {
+    size += _shards[i].size();
+  }
+  return size;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+size_t ShardedQueue<T, SmartPtr, Wait>::size_approx() const {
+  size_t size = 0;
+  for (size_t i = 0; i < _count; ++i) {
+    size += _shards[i].size_approx();
+  }
+  return size;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool ShardedQueue<T, SmartPtr, Wait>::empty_approx() const {
+  for (size_t i = 0; i < _count; ++i) {
+    if (!_shards[i].empty_approx()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool ShardedQueue<T, SmartPtr, Wait>::push(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool ShardedQueue<T, SmartPtr, Wait>::push(T &&value) {
+  return emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class... Args>
+bool ShardedQueue<T, SmartPtr, Wait>::emplace(Args &&...args) {
+  if (!_shards[local()].emplace(std::forward<Args>(args)...)) {
+    return false;
+  }
+  _parking.notify_one();
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+SmartPtr<T> ShardedQueue<T, SmartPtr, Wait>::pop_try() {
+  size_t home = local();
+  if (!_shards[home].empty_approx()) {
+    SmartPtr<T> value = _shards[home].pop_try();
+    if (value) {
+      return value;
+    }
+  }
+  size_t start = _steal.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i = 0; i < _count; ++i) {
+    size_t index = (start + i) % _count;
+    Queue<T, SmartPtr> &shard = _shards[index];
+    // 窃取时跳过本地分片和看起来为空的分片，不去碰它们的锁
+    if (index == home || shard.empty_approx()) {
+      continue;
+    }
+    SmartPtr<T> value = shard.pop_try();
+    if (value) {
+      return value;
+    }
+  }
+  return {};
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+SmartPtr<T> ShardedQueue<T, SmartPtr, Wait>::pop_must() {
+  SmartPtr<T> value;
+  _parking.wait([&]() {
+    // 先读closed：看到关闭时，关闭之前完成的push一定能被下面的pop_try看到
+    bool stop = closed();
+    value = pop_try();
+    return value || stop;
+  });
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class Rep, class Period>
+SmartPtr<T> ShardedQueue<T, SmartPtr, Wait>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class Clock, class Duration>
+SmartPtr<T> ShardedQueue<T, SmartPtr, Wait>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  SmartPtr<T> value;
+  _parking.wait_until(
+      [&]() {
+        bool stop = closed();
+        value = pop_try();
+        return value || stop;
+      },
+      timeout_time);
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+void ShardedQueue<T, SmartPtr, Wait>::close() {
+  for (size_t i = 0; i < _count; ++i) {
+    _shards[i].close();
+  }
+  _closed.store(true);
+  _parking.notify_all();
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+bool ShardedQueue<T, SmartPtr, Wait>::closed() const {
+  return _closed.load(std::memory_order_acquire);
+}
+
+template <typename T, template <typename> class SmartPtr, class Wait>
+template <class OutputIt>
+size_t ShardedQueue<T, SmartPtr, Wait>::drain_into(OutputIt out) {
+  size_t count = 0;
+  for (size_t i = 0; i < _count; ++i) {
+    // 以引用传入，让out在分片之间继续前进
+    count += _shards[i].template drain_into<OutputIt &>(out);
+  }
+  return count;
+}
+}; // namespace ThreadSafe
@@ -0,0 +1,691 @@
+#pragma once
+
+// 跨进程的共享内存队列，只支持Linux(shm_open + futex)，这时定义THREAD_SAFE_SHM
+#ifdef __linux__
+#define THREAD_SAFE_SHM 1
+
+#include "detail_ts.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ThreadSafe {
+namespace detail {
+
+// 不带FUTEX_PRIVATE_FLAG，等待和唤醒可以来自映射同一块内存的不同进程
+inline void futex_wait(std::atomic<uint32_t> &word, uint32_t expected,
+                       const timespec *timeout) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT,
+            expected, timeout, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<uint32_t> &word, int count) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, count,
+            nullptr, nullptr, 0);
+}
+
+inline bool process_alive(uint32_t pid) {
+  return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+} // namespace detail
+
+// 映射在shm_open区域里的有界MPMC环形队列，槽位内直接存放可平凡复制的T，
+// 生产者和消费者可以在不同的进程里。接口与Queue<T, Inline>相同，
+// pop返回std::optional<T>。
+// 阻塞的push / pop用futex在进程之间等待和唤醒。
+// 对端崩溃的恢复：每次push / pop在共享的记录表里登记自己的pid和要领取的下标，
+// 发现某个下标被领取后一直没有完成、而登记它的进程都已经退出时，
+// 消费者用一次CAS把该槽位标记为作废后跳过，生产者把该槽位直接交还给下一轮，
+// 死掉的进程正在写入或读取的那一个元素丢失，队列的其余部分继续工作。
+// 队列内容在所有进程退出后仍然保留，直到remove(name)。
+template <typename T, size_t Capacity> class ShmQueue {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "ShmQueue requires a trivially copyable T");
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                    std::atomic<uint32_t>::is_always_lock_free,
+                "ShmQueue requires lock-free 32 and 64 bit atomics");
+
+public:
+  enum class Mode { create, open, open_or_create };
+
+  // name为shm_open的名字(以'/'开头)。create要求名字不存在，open要求已经存在；
+  // 已存在的区域若容量或元素大小不同，抛出std::system_error(EINVAL)
+  explicit ShmQueue(const std::string &name, Mode mode = Mode::open_or_create);
+  ~ShmQueue();
+
+  ShmQueue(const ShmQueue &) = delete;
+  ShmQueue &operator=(const ShmQueue &) = delete;
+
+  // 删除共享内存的名字，已经映射的进程不受影响
+  static bool remove(const std::string &name);
+
+  // close()之后所有push都返回false
+  bool push(const T &value);
+  bool push_try(const T &value);
+
+  template <class Rep, class Period>
+  bool push_for(const T &value,
+                const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  bool push_until(const T &value,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  template <class... Args> bool emplace(Args &&...args);
+  template <class... Args> bool try_emplace(Args &&...args);
+
+  std::optional<T> pop_must();
+  std::optional<T> pop_try();
+
+  template <class Rep, class Period>
+  std::optional<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  std::optional<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // 关闭对所有映射了这个队列的进程生效
+  void close();
+  bool closed() const;
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  size_t size_approx() const;
+  bool empty_approx() const;
+  size_t capacity() const;
+  // 因对端崩溃而作废或回收的槽位数
+  size_t recovered() const;
+
+private:
+  static constexpr uint64_t magic = 0x5453514d48535356ull;
+  static constexpr size_t record_count = 128;
+  static constexpr uint64_t no_pos = UINT64_MAX;
+  // 正在被回收的记录的pid：先由回收方从死去的pid CAS过来，清空之后才置0，
+  // acquire_record只领取pid为0的记录
+  static constexpr uint32_t reaping = UINT32_MAX;
+  // seq的最高位：生产者崩溃后作废的槽位。与下标一起由一次CAS写入，
+  // 并发的恢复方中只有CAS成功的一方改变槽位
+  static constexpr uint64_t invalid = uint64_t(1) << 63;
+
+  enum Side : uint32_t { producer = 1, consumer = 2 };
+  enum class Take { value, empty, skipped };
+
+  // 每次push / pop都写自己的记录，不同进程的记录不共享缓存行
+  struct alignas(detail::cache_line) Record {
+    std::atomic<uint32_t> pid;
+    std::atomic<uint32_t> side;
+    std::atomic<uint64_t> pos;
+  };
+
+  struct alignas(detail::cache_line) Header {
+    uint64_t magic;
+    uint64_t capacity;
+    uint64_t value_size;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> closed;
+    std::atomic<uint64_t> recovered;
+    alignas(detail::cache_line) std::atomic<uint64_t> enqueue_pos;
+    alignas(detail::cache_line) std::atomic<uint64_t> dequeue_pos;
+    // futex字：每次发布 / 释放槽位加一，等待者比较它有没有变化
+    alignas(detail::cache_line) std::atomic<uint32_t> not_empty;
+    std::atomic<uint32_t> pop_waiters;
+    alignas(detail::cache_line) std::atomic<uint32_t> not_full;
+    std::atomic<uint32_t> push_waiters;
+    alignas(detail::cache_line) Record records[record_count];
+  };
+
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    alignas(T) unsigned char data[sizeof(T)];
+  };
+
+  struct Region {
+    Header header;
+    Slot slots[Capacity];
+  };
+
+  void attach(bool created);
+
+  Record &acquire_record(Side side);
+  void release_record(Record &record);
+  void free_dead_record(Record &record, uint32_t owner);
+  bool claimants_dead(Side side, uint64_t pos);
+  void reap(Side side, uint64_t pos);
+
+  bool enqueue(const T &value);
+  Take dequeue(unsigned char *value);
+  bool recover_producer(Slot &slot, uint64_t pos);
+  bool recover_consumer(Slot &slot, uint64_t pos);
+
+  void notify(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiters,
+              int count);
+  template <class Ready, class Clock, class Duration>
+  bool block(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiters,
+             Ready ready,
+             const std::chrono::time_point<Clock, Duration> *timeout_time);
+
+  template <class Clock, class Duration>
+  std::optional<T>
+  take(const std::chrono::time_point<Clock, Duration> *timeout_time);
+  template <class Clock, class Duration>
+  bool put(const T &value,
+           const std::chrono::time_point<Clock, Duration> *timeout_time);
+
+  int _fd = -1;
+  Region *_region = nullptr;
+};
+
+template <typename T, size_t Capacity>
+ShmQueue<T, Capacity>::ShmQueue(const std::string &name, Mode mode) {
+  bool created = false;
+  if (mode != Mode::open) {
+    _fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    created = _fd >= 0;
+    if (!created && (errno != EEXIST || mode == Mode::create)) {
+      throw std::system_error(errno, std::generic_category(), "shm_open");
+    }
+  }
+  if (!created) {
+    _fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    if (_fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "shm_open");
+    }
+  }
+  try {
+    attach(created);
+  } catch (...) {
+    if (_region != nullptr) {
+      ::munmap(_region, sizeof(Region));
+    }
+    ::close(_fd);
+    if (created) {
+      ::shm_unlink(name.c_str());
+    }
+    throw;
+  }
+}
+
+template <typename T, size_t Capacity>
+void ShmQueue<T, Capacity>::attach(bool created) {
+  auto fail = [](int error, const char *what) {
+    throw std::system_error(error, std::generic_category(), what);
+  };
+  if (created) {
+    if (::ftruncate(_fd, sizeof(Region)) != 0) {
+      fail(errno, "ftruncate");
+    }
+  } else {
+    // 创建方可能还没来得及ftruncate
+    struct stat st;
+    for (int i = 0;; ++i) {
+      if (::fstat(_fd, &st) != 0) {
+        fail(errno, "fstat");
+      }
+      if (static_cast<size_t>(st.st_size) >= sizeof(Region)) {
+        break;
+      }
+      if (st.st_size != 0 || i == 1000) {
+        fail(EINVAL, "ShmQueue size mismatch");
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  void *memory = ::mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, _fd, 0);
+  if (memory == MAP_FAILED) {
+    fail(errno, "mmap");
+  }
+  _region = static_cast<Region *>(memory);
+  Header &header = _region->header;
+  if (created) {
+    // ftruncate之后内容全为0，只需要填写非0的字段
+    new (memory) Region;
+    for (size_t i = 0; i < Capacity; ++i) {
+      _region->slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    for (Record &record : header.records) {
+      record.pos.store(no_pos, std::memory_order_relaxed);
+    }
+    header.magic = magic;
+    header.capacity = Capacity;
+    header.value_size = sizeof(T);
+    header.ready.store(1, std::memory_order_release);
+    return;
+  }
+  for (int i = 0; header.ready.load(std::memory_order_acquire) == 0; ++i) {
+    if (i == 1000) {
+      fail(ETIMEDOUT, "ShmQueue not initialized");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (header.magic != magic || header.capacity != Capacity ||
+      header.value_size != sizeof(T)) {
+    fail(EINVAL, "ShmQueue layout mismatch");
+  }
+}
+
+template <typename T, size_t Capacity> ShmQueue<T, Capacity>::~ShmQueue() {
+  ::munmap(_region, sizeof(Region));
+  ::close(_fd);
+}
+
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::remove(const std::string &name) {
+  return ::shm_unlink(name.c_str()) == 0;
+}
+
+// 每次操作借用一条记录，优先使用按线程编号对应的那条；全部被占用时回收
+// 已经退出的进程留下的记录。pid每次重新读取，fork出的子进程可以继续使用
+// 父进程的映射
+template <typename T, size_t Capacity>
+auto ShmQueue<T, Capacity>::acquire_record(Side side) -> Record & {
+  Record *records = _region->header.records;
+  size_t start = detail::thread_index() % record_count;
+  uint32_t pid = static_cast<uint32_t>(::getpid());
+  for (;;) {
+    for (size_t i = 0; i < record_count; ++i) {
+      Record &record = records[(start + i) % record_count];
+      uint32_t expected = 0;
+      if (record.pid.load(std::memory_order_relaxed) == 0 &&
+          record.pid.compare_exchange_strong(expected, pid)) {
+        record.side.store(side);
+        return record;
+      }
+    }
+    for (size_t i = 0; i < record_count; ++i) {
+      uint32_t owner = records[i].pid.load();
+      if (owner != 0 && owner != reaping && !detail::process_alive(owner)) {
+        free_dead_record(records[i], owner);
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+template <typename T, size_t Capacity>
+void ShmQueue<T, Capacity>::release_record(Record &record) {
+  record.pos.store(no_pos);
+  record.side.store(0);
+  record.pid.store(0);
+}
+
+// 先把pid从owner换成reaping再清空：CAS失败说明别的回收方已经释放了这条记录，
+// 它可能已经被活着的进程重新领取，不能再写它的pos
+template <typename T, size_t Capacity>
+void ShmQueue<T, Capacity>::free_dead_record(Record &record, uint32_t owner) {
+  if (record.pid.compare_exchange_strong(owner, reaping)) {
+    release_record(record);
+  }
+}
+
+// 下标pos的领取者一定在pos相同的记录里(领取之前登记，完成之后才清除)；
+// 登记了pos的记录全部属于已退出的进程，才能确定领取者已经死了
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::claimants_dead(Side side, uint64_t pos) {
+  for (Record &record : _region->header.records) {
+    uint32_t pid = record.pid.load();
+    if (pid == 0 || pid == reaping || record.side.load() != side ||
+        record.pos.load() != pos) {
+      continue;
+    }
+    if (detail::process_alive(pid)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 槽位恢复之后释放死去的进程留下的、登记为pos的记录
+template <typename T, size_t Capacity>
+void ShmQueue<T, Capacity>::reap(Side side, uint64_t pos) {
+  for (Record &record : _region->header.records) {
+    uint32_t pid = record.pid.load();
+    if (pid != 0 && pid != reaping && record.side.load() == side &&
+        record.pos.load() == pos && !detail::process_alive(pid)) {
+      free_dead_record(record, pid);
+    }
+  }
+}
+
+// slot.seq == pos：空槽位，或者生产者领取了还没发布。
+// 后者且生产者已死时把seq直接改为作废的pos + 1；晚到的恢复方CAS失败，
+// 不会碰到已经进入下一轮的槽位
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::recover_producer(Slot &slot, uint64_t pos) {
+  Header &header = _region->header;
+  if (header.enqueue_pos.load() <= pos || !claimants_dead(producer, pos)) {
+    return false;
+  }
+  uint64_t expected = pos;
+  if (slot.seq.compare_exchange_strong(expected, (pos + 1) | invalid)) {
+    header.recovered.fetch_add(1);
+  }
+  reap(producer, pos);
+  return true;
+}
+
+// slot.seq == pos + 1：已发布还没取走，或者消费者领取了还没释放。
+// 后者且消费者已死时把槽位直接交还给下一轮的生产者
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::recover_consumer(Slot &slot, uint64_t pos) {
+  Header &header = _region->header;
+  if (header.dequeue_pos.load() <= pos || !claimants_dead(consumer, pos)) {
+    return false;
+  }
+  uint64_t expected = slot.seq.load();
+  if ((expected & ~invalid) == pos + 1 &&
+      slot.seq.compare_exchange_strong(expected, pos + Capacity)) {
+    header.recovered.fetch_add(1);
+  }
+  reap(consumer, pos);
+  return true;
+}
+
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::enqueue(const T &value) {
+  Header &header = _region->header;
+  Record &record = acquire_record(producer);
+  uint64_t pos = header.enqueue_pos.load(std::memory_order_relaxed);
+  bool ok = false;
+  for (;;) {
+    Slot &slot = _region->slots[pos & (Capacity - 1)];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire) & ~invalid;
+    if (seq == pos) {
+      // 先登记再领取，崩溃时别的进程能找到这条记录
+      record.pos.store(pos);
+      if (header.enqueue_pos.compare_exchange_weak(pos, pos + 1)) {
+        std::memcpy(slot.data, &value, sizeof(T));
+        slot.seq.store(pos + 1, std::memory_order_release);
+        ok = true;
+        break;
+      }
+    } else if (seq < pos) {
+      // 上一轮的元素还没取走：队列满，或者取它的消费者已经死了
+      uint64_t previous = pos - Capacity;
+      if (seq != previous + 1 || !recover_consumer(slot, previous)) {
+        break;
+      }
+    } else {
+      pos = header.enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  release_record(record);
+  return ok;
+}
+
+template <typename T, size_t Capacity>
+auto ShmQueue<T, Capacity>::dequeue(unsigned char *value) -> Take {
+  Header &header = _region->header;
+  Record &record = acquire_record(consumer);
+  uint64_t pos = header.dequeue_pos.load(std::memory_order_relaxed);
+  Take result = Take::empty;
+  for (;;) {
+    Slot &slot = _region->slots[pos & (Capacity - 1)];
+    uint64_t raw = slot.seq.load(std::memory_order_acquire);
+    uint64_t seq = raw & ~invalid;
+    if (seq == pos + 1) {
+      record.pos.store(pos);
+      // 领取成功时raw仍是槽位的当前值：pos + 1只能由pos的领取者改变
+      if (header.dequeue_pos.compare_exchange_weak(pos, pos + 1)) {
+        bool valid = (raw & invalid) == 0;
+        if (valid) {
+          std::memcpy(value, slot.data, sizeof(T));
+        }
+        slot.seq.store(pos + Capacity, std::memory_order_release);
+        result = valid ? Take::value : Take::skipped;
+        break;
+      }
+    } else if (seq <= pos) {
+      if (seq != pos || !recover_producer(slot, pos)) {
+        break;
+      }
+    } else {
+      pos = header.dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  release_record(record);
+  return result;
+}
+
+template <typename T, size_t Capacity>
+void ShmQueue<T, Capacity>::notify(std::atomic<uint32_t> &word,
+                                   std::atomic<uint32_t> &waiters, int count) {
+  word.fetch_add(1);
+  if (waiters.load() != 0) {
+    detail::futex_wake(word, count);
+  }
+}
+
+// ready()失败之后读取futex字再睡眠：期间的任何通知都会改变futex字，
+// futex_wait发现值不同立即返回，不会丢失唤醒
+template <typename T, size_t Capacity>
+template <class Ready, class Clock, class Duration>
+bool ShmQueue<T, Capacity>::block(
+    std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiters, Ready ready,
+    const std::chrono::time_point<Clock, Duration> *timeout_time) {
+  for (;;) {
+    uint32_t seen = word.load();
+    if (ready()) {
+      return true;
+    }
+    timespec timeout{};
+    if (timeout_time != nullptr) {
+      auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          *timeout_time - Clock::now());
+      if (remaining.count() <= 0) {
+        return false;
+      }
+      timeout.tv_sec = static_cast<time_t>(remaining.count() / 1000000000);
+      timeout.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+    }
+    waiters.fetch_add(1);
+    if (ready()) {
+      waiters.fetch_sub(1);
+      return true;
+    }
+    detail::futex_wait(word, seen,
+                       timeout_time != nullptr ? &timeout : nullptr);
+    waiters.fetch_sub(1);
+  }
+}
+
+template <typename T, size_t Capacity>
+template <class Clock, class Duration>
+std::optional<T> ShmQueue<T, Capacity>::take(
+    const std::chrono::time_point<Clock, Duration> *timeout_time) {
+  Header &header = _region->header;
+  std::optional<T> result;
+  block(
+      header.not_empty, header.pop_waiters,
+      [&]() {
+        bool stop = closed();
+        // T不要求可以默认构造：元素先复制到字节缓冲区里
+        alignas(T) unsigned char value[sizeof(T)];
+        for (;;) {
+          Take took = dequeue(value);
+          if (took == Take::empty) {
+            return stop;
+          }
+          notify(header.not_full, header.push_waiters, 1);
+          if (took == Take::value) {
+            result.emplace(*std::launder(reinterpret_cast<T *>(value)));
+            return true;
+          }
+        }
+      },
+      timeout_time);
+  return result;
+}
+
+template <typename T, size_t Capacity>
+template <class Clock, class Duration>
+bool ShmQueue<T, Capacity>::put(
+    const T &value,
+    const std::chrono::time_point<Clock, Duration> *timeout_time) {
+  Header &header = _region->header;
+  bool ok = false;
+  block(
+      header.not_full, header.push_waiters,
+      [&]() {
+        if (closed()) {
+          return true;
+        }
+        ok = enqueue(value);
+        return ok;
+      },
+      timeout_time);
+  if (ok) {
+    notify(header.not_empty, header.pop_waiters, 1);
+  }
+  return ok;
+}
+
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::push(const T &value) {
+  return put<std::chrono::steady_clock, std::chrono::steady_clock::duration>(
+      value, nullptr);
+}
+
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::push_try(const T &value) {
+  if (closed() || !enqueue(value)) {
+    return false;
+  }
+  notify(_region->header.not_empty, _region->header.pop_waiters, 1);
+  return true;
+}
+
+template <typename T, size_t Capacity>
+template <class Rep, class Period>
+bool ShmQueue<T, Capacity>::push_for(
+    const T &value, const std::chrono::duration<Rep, Period> &timeout) {
+  return push_until(value, std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, size_t Capacity>
+template <class Clock, class Duration>
+bool ShmQueue<T, Capacity>::push_until(
+    const T &value,
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return put(value, &timeout_time);
+}
+
+template <typename T, size_t Capacity>
+template <class... Args>
+bool ShmQueue<T, Capacity>::emplace(Args &&...args) {
+  return push(T(std::forward<Args>(args)...));
+}
+
+template <typename T, size_t Capacity>
+template <class... Args>
+bool ShmQueue<T, Capacity>::try_emplace(Args &&...args) {
+  return push_try(T(std::forward<Args>(args)...));
+}
+
+template <typename T, size_t Capacity>
+std::optional<T> ShmQueue<T, Capacity>::pop_must() {
+  return take<std::chrono::steady_clock, std::chrono::steady_clock::duration>(
+      nullptr);
+}
+
+template <typename T, size_t Capacity>
+std::optional<T> ShmQueue<T, Capacity>::pop_try() {
+  alignas(T) unsigned char value[sizeof(T)];
+  for (;;) {
+    Take took = dequeue(value);
+    if (took == Take::empty) {
+      return {};
+    }
+    notify(_region->header.not_full, _region->header.push_waiters, 1);
+    if (took == Take::value) {
+      return *std::launder(reinterpret_cast<T *>(value));
+    }
+  }
+}
+
+template <typename T, size_t Capacity>
+template <class Rep, class Period>
+std::optional<T> ShmQueue<T, Capacity>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, size_t Capacity>
+template <class Clock, class Duration>
+std::optional<T> ShmQueue<T, Capacity>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return take(&timeout_time);
+}
+
+template <typename T, size_t Capacity> void ShmQueue<T, Capacity>::close() {
+  Header &header = _region->header;
+  header.closed.store(1);
+  notify(header.not_empty, header.pop_waiters, INT_MAX);
+  notify(header.not_full, header.push_waiters, INT_MAX);
+}
+
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::closed() const {
+  return _region->header.closed.load() != 0;
+}
+
+template <typename T, size_t Capacity>
+template <class OutputIt>
+size_t ShmQueue<T, Capacity>::drain_into(OutputIt out) {
+  size_t count = 0;
+  while (std::optional<T> value = pop_try()) {
+    *out = *value;
+    ++out;
+    ++count;
+  }
+  return count;
+}
+
+template <typename T, size_t Capacity>
+size_t ShmQueue<T, Capacity>::size_approx() const {
+  uint64_t tail = _region->header.enqueue_pos.load(std::memory_order_relaxed);
+  uint64_t head = _region->header.dequeue_pos.load(std::memory_order_relaxed);
+  if (tail <= head) {
+    return 0;
+  }
+  return tail - head > Capacity ? Capacity : static_cast<size_t>(tail - head);
+}
+
+template <typename T, size_t Capacity>
+bool ShmQueue<T, Capacity>::empty_approx() const {
+  return size_approx() == 0;
+}
+
+template <typename T, size_t Capacity>
+size_t ShmQueue<T, Capacity>::capacity() const {
+  return Capacity;
+}
+
+template <typename T, size_t Capacity>
+size_t ShmQueue<T, Capacity>::recovered() const {
+  return static_cast<size_t>(_region->header.recovered.load());
+}
+}; // namespace ThreadSafe
+
+#endif
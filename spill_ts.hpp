@@ -0,0 +1,657 @@
+#pragma once
+
+// 溢出到磁盘的队列，只支持Linux(mmap + posix_fallocate)，定义THREAD_SAFE_SPILL
+#ifdef __linux__
+#define THREAD_SAFE_SPILL 1
+
+#include "detail_ts.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ThreadSafe {
+namespace detail {
+
+// 一个段文件：文件头之后是定长记录，每条记录是一个标记字加上元素的字节。
+// 标记在元素写完之后才写入，重新打开时从头部记下的读下标开始，
+// 标记连续有效的记录就是还没取出的元素。段由SpillQueue持锁访问。
+class SpillSegment {
+public:
+  // create为true时新建并用posix_fallocate预留全部空间(磁盘满时在这里抛出，
+  // 而不是写入映射时收到SIGBUS)，否则打开已有的段并恢复读写位置
+  SpillSegment(std::string path, size_t payload_size, size_t payload_align,
+               size_t records, bool create);
+  ~SpillSegment();
+
+  SpillSegment(const SpillSegment &) = delete;
+  SpillSegment &operator=(const SpillSegment &) = delete;
+
+  const std::string &path() const { return _path; }
+  size_t records() const { return _records; }
+  size_t written() const { return _written; }
+  size_t read() const { return _header->read; }
+  bool full() const { return _written == _records; }
+  bool drained() const { return _header->read == _written; }
+
+  void append(const void *value);
+  void consume(void *value);
+
+  // 把[_synced, _written)的记录写回磁盘；header为true时同时写回文件头(读下标)
+  void sync(size_t from, size_t to, bool header) const;
+  size_t synced() const { return _synced; }
+  void mark_synced(size_t to) { _synced = to; }
+
+private:
+  static constexpr uint64_t magic = 0x4c4c495053535354ull;
+
+  struct Header {
+    uint64_t magic;
+    uint64_t record_size;
+    uint64_t records;
+    uint64_t read;
+  };
+
+  uint64_t mark_of(size_t index) const { return magic ^ (index + 1); }
+  unsigned char *record(size_t index) const {
+    return _base + _header_size + index * _record_size;
+  }
+  void msync_range(size_t begin, size_t end) const;
+
+  std::string _path;
+  int _fd = -1;
+  unsigned char *_base = nullptr;
+  Header *_header = nullptr;
+  size_t _payload_size;
+  size_t _payload_offset;
+  size_t _record_size;
+  size_t _header_size;
+  size_t _records;
+  size_t _bytes;
+  size_t _written = 0;
+  size_t _synced = 0;
+};
+
+inline SpillSegment::SpillSegment(std::string path, size_t payload_size,
+                                  size_t payload_align, size_t records,
+                                  bool create)
+    : _path(std::move(path)), _payload_size(payload_size) {
+  auto round_up = [](size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+  };
+  size_t align = std::max(payload_align, alignof(uint64_t));
+  _payload_offset = round_up(sizeof(uint64_t), align);
+  _record_size = round_up(_payload_offset + payload_size, align);
+  _header_size = round_up(sizeof(Header), std::max(align, cache_line));
+  auto fail = [this](int error, const char *what) {
+    if (_base != nullptr) {
+      ::munmap(_base, _bytes);
+    }
+    if (_fd >= 0) {
+      ::close(_fd);
+    }
+    throw std::system_error(error, std::generic_category(), what);
+  };
+
+  if (create) {
+    _records = records;
+    _bytes = _header_size + _records * _record_size;
+    _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (_fd < 0) {
+      fail(errno, "open");
+    }
+    int error = ::posix_fallocate(_fd, 0, static_cast<off_t>(_bytes));
+    if (error != 0) {
+      ::unlink(_path.c_str());
+      fail(error, "posix_fallocate");
+    }
+  } else {
+    _fd = ::open(_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (_fd < 0) {
+      fail(errno, "open");
+    }
+    struct stat st;
+    if (::fstat(_fd, &st) != 0) {
+      fail(errno, "fstat");
+    }
+    _bytes = static_cast<size_t>(st.st_size);
+    if (_bytes < _header_size) {
+      fail(EINVAL, "spill segment truncated");
+    }
+  }
+  void *memory =
+      ::mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if (memory == MAP_FAILED) {
+    fail(errno, "mmap");
+  }
+  _base = static_cast<unsigned char *>(memory);
+  _header = reinterpret_cast<Header *>(_base);
+
+  if (create) {
+    // 预留的空间全为0，标记全部无效
+    _header->magic = magic;
+    _header->record_size = _record_size;
+    _header->records = _records;
+    _header->read = 0;
+    return;
+  }
+  if (_header->magic != magic || _header->record_size != _record_size ||
+      _header->records > (_bytes - _header_size) / _record_size ||
+      _header->read > _header->records) {
+    fail(EINVAL, "spill segment layout mismatch");
+  }
+  _records = static_cast<size_t>(_header->records);
+  _written = static_cast<size_t>(_header->read);
+  while (_written < _records) {
+    uint64_t mark;
+    std::memcpy(&mark, record(_written), sizeof(mark));
+    if (mark != mark_of(_written)) {
+      break;
+    }
+    ++_written;
+  }
+  _synced = _written;
+}
+
+inline SpillSegment::~SpillSegment() {
+  ::munmap(_base, _bytes);
+  ::close(_fd);
+}
+
+inline void SpillSegment::append(const void *value) {
+  unsigned char *slot = record(_written);
+  std::memcpy(slot + _payload_offset, value, _payload_size);
+  uint64_t mark = mark_of(_written);
+  std::memcpy(slot, &mark, sizeof(mark));
+  ++_written;
+}
+
+inline void SpillSegment::consume(void *value) {
+  std::memcpy(value, record(_header->read) + _payload_offset, _payload_size);
+  ++_header->read;
+}
+
+inline void SpillSegment::msync_range(size_t begin, size_t end) const {
+  static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  begin = begin / page * page;
+  if (::msync(_base + begin, end - begin, MS_SYNC) != 0) {
+    throw std::system_error(errno, std::generic_category(), "msync");
+  }
+}
+
+inline void SpillSegment::sync(size_t from, size_t to, bool header) const {
+  if (from < to) {
+    msync_range(_header_size + from * _record_size,
+                _header_size + to * _record_size);
+  }
+  if (header) {
+    msync_range(0, sizeof(Header));
+  }
+}
+} // namespace detail
+
+// 内存中的元素达到high_water之后，新元素追加到目录下mmap的段文件里，
+// 消费者取完内存中的元素后再按FIFO顺序从段文件读回，
+// 内存占用不超过high_water个元素。一旦开始溢出，之后的元素都写进段文件，
+// 直到段文件里的元素取完，所以整体保持FIFO。
+// 写入只是对映射的顺序memcpy，每累计sync_bytes字节才msync一次。
+// 段文件在进程退出后保留：用同一目录构造的SpillQueue会先交付上次
+// 没有取出的元素。
+// 进程崩溃不影响已经写进映射的内容；系统掉电时最后一次sync之后写入的元素
+// 可能丢失，之后取出的元素可能再交付一次(读下标同样随sync写回)。
+// 内存中的元素不落盘。
+// 溢出的元素按字节写入文件，T必须可平凡复制。
+template <typename T, template <typename> class SmartPtr> class SpillQueue {
+  static_assert(detail::is_storage_v<T, SmartPtr>,
+                "SmartPtr must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+  static_assert(std::is_trivially_copyable_v<T>,
+                "SpillQueue requires a trivially copyable T");
+
+public:
+  // directory不存在时创建；segment_bytes为单个段文件的大小
+  SpillQueue(std::string directory, size_t high_water,
+             size_t segment_bytes = size_t(64) << 20,
+             size_t sync_bytes = size_t(4) << 20);
+  // 写回全部段文件，删除已经取完的段
+  ~SpillQueue();
+
+  SpillQueue(const SpillQueue &) = delete;
+  SpillQueue &operator=(const SpillQueue &) = delete;
+
+  // 无界，close()之前总是成功；创建段文件失败时抛出std::system_error
+  bool push(const T &value);
+  bool push(T &&value);
+  bool push_try(const T &value);
+  bool push_try(T &&value);
+
+  template <class... Args> bool emplace(Args &&...args);
+  template <class... Args> bool try_emplace(Args &&...args);
+
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  void close();
+  bool closed() const;
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  // 立即把所有段文件(包括读下标)写回磁盘，失败时抛出std::system_error
+  void sync();
+
+  size_t size() const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+  // 当前在段文件里的元素个数
+  size_t spilled_approx() const;
+
+private:
+  using stored_type = detail::stored_t<T, SmartPtr>;
+  using Segment = detail::SpillSegment;
+
+  struct Flush {
+    std::shared_ptr<Segment> segment;
+    size_t from;
+    size_t to;
+  };
+
+  const T &ref(const stored_type &value) const;
+  SmartPtr<T> wrap(stored_type &&value) const;
+
+  void recover();
+  std::shared_ptr<Segment> open_segment();
+  void drop_drained();
+  void collect(std::vector<Flush> &flushes, bool all);
+  void flush(std::vector<Flush> &flushes, bool header);
+
+  bool insert(stored_type &&value);
+  bool take_locked(std::optional<stored_type> &memory, void *disk);
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  take_until(const std::chrono::time_point<Clock, Duration> *timeout_time);
+
+  std::string _directory;
+  size_t _high_water;
+  size_t _segment_records;
+  size_t _sync_bytes;
+
+  mutable std::mutex _lock;
+  std::condition_variable _cv;
+  std::deque<stored_type> _memory;
+  // 按序号排列，front正在读，back正在写
+  std::deque<std::shared_ptr<Segment>> _segments;
+  uint64_t _next_sequence = 0;
+  size_t _unsynced = 0;
+  std::atomic<size_t> _count{0};
+  std::atomic<size_t> _spilled{0};
+  std::atomic<bool> _closed{false};
+};
+
+template <typename T, template <typename> class SmartPtr>
+SpillQueue<T, SmartPtr>::SpillQueue(std::string directory, size_t high_water,
+                                    size_t segment_bytes, size_t sync_bytes)
+    : _directory(std::move(directory)), _high_water(high_water),
+      _sync_bytes(sync_bytes) {
+  // 按记录的最大尺寸(标记字加对齐后的元素)估算每段的记录数
+  size_t record = sizeof(uint64_t) + sizeof(T) + alignof(T);
+  _segment_records = std::max<size_t>(segment_bytes / record, 1);
+  if (::mkdir(_directory.c_str(), 0700) != 0 && errno != EEXIST) {
+    throw std::system_error(errno, std::generic_category(), "mkdir");
+  }
+  recover();
+}
+
+template <typename T, template <typename> class SmartPtr>
+SpillQueue<T, SmartPtr>::~SpillQueue() {
+  std::vector<Flush> flushes;
+  collect(flushes, true);
+  try {
+    flush(flushes, true);
+  } catch (const std::system_error &) {
+  }
+  for (const std::shared_ptr<Segment> &segment : _segments) {
+    if (segment->drained()) {
+      ::unlink(segment->path().c_str());
+    }
+  }
+}
+
+template <typename T, template <typename> class SmartPtr>
+const T &SpillQueue<T, SmartPtr>::ref(const stored_type &value) const {
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    return value;
+  } else {
+    return *value;
+  }
+}
+
+template <typename T, template <typename> class SmartPtr>
+SmartPtr<T> SpillQueue<T, SmartPtr>::wrap(stored_type &&value) const {
+  return SmartPtr<T>(std::move(value));
+}
+
+// 段文件名为20位十进制序号加.spill，按序号从小到大恢复
+template <typename T, template <typename> class SmartPtr>
+void SpillQueue<T, SmartPtr>::recover() {
+  DIR *dir = ::opendir(_directory.c_str());
+  if (dir == nullptr) {
+    throw std::system_error(errno, std::generic_category(), "opendir");
+  }
+  std::vector<uint64_t> sequences;
+  while (dirent *entry = ::readdir(dir)) {
+    const char *name = entry->d_name;
+    char *end = nullptr;
+    unsigned long long sequence = std::strtoull(name, &end, 10);
+    if (end == name + 20 && std::strcmp(end, ".spill") == 0) {
+      sequences.push_back(sequence);
+    }
+  }
+  ::closedir(dir);
+  std::sort(sequences.begin(), sequences.end());
+
+  size_t spilled = 0;
+  for (uint64_t sequence : sequences) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%020llu.spill",
+                  static_cast<unsigned long long>(sequence));
+    auto segment = std::make_shared<Segment>(
+        _directory + name, sizeof(T), alignof(T), 0, false);
+    _next_sequence = sequence + 1;
+    bool last = sequence == sequences.back();
+    if (segment->drained() && (segment->full() || !last)) {
+      ::unlink(segment->path().c_str());
+      continue;
+    }
+    spilled += segment->written() - segment->read();
+    _segments.push_back(std::move(segment));
+  }
+  _spilled.store(spilled, std::memory_order_relaxed);
+  _count.store(spilled, std::memory_order_relaxed);
+}
+
+// 持锁调用，返回可以写入的段，需要时新建
+template <typename T, template <typename> class SmartPtr>
+auto SpillQueue<T, SmartPtr>::open_segment() -> std::shared_ptr<Segment> {
+  if (!_segments.empty() && !_segments.back()->full()) {
+    return _segments.back();
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%020llu.spill",
+                static_cast<unsigned long long>(_next_sequence));
+  auto segment = std::make_shared<Segment>(_directory + name, sizeof(T),
+                                           alignof(T), _segment_records, true);
+  ++_next_sequence;
+  _segments.push_back(segment);
+  return segment;
+}
+
+// 持锁调用：取完的段直接删除，正在写的最后一段除外(与recover()相同)。
+// 掉电后恢复的中间段可能没有写满，它不会再被写入，取完也要删除
+template <typename T, template <typename> class SmartPtr>
+void SpillQueue<T, SmartPtr>::drop_drained() {
+  while (!_segments.empty() && _segments.front()->drained() &&
+         (_segments.front()->full() || _segments.size() > 1)) {
+    ::unlink(_segments.front()->path().c_str());
+    _segments.pop_front();
+  }
+}
+
+// 持锁调用，收集还没写回的记录范围；msync在释放锁之后进行，
+// shared_ptr保证期间段不会被消费者删除后解除映射
+template <typename T, template <typename> class SmartPtr>
+void SpillQueue<T, SmartPtr>::collect(std::vector<Flush> &flushes, bool all) {
+  for (const std::shared_ptr<Segment> &segment : _segments) {
+    if (all || segment->synced() < segment->written()) {
+      flushes.push_back({segment, segment->synced(), segment->written()});
+      segment->mark_synced(segment->written());
+    }
+  }
+  _unsynced = 0;
+}
+
+template <typename T, template <typename> class SmartPtr>
+void SpillQueue<T, SmartPtr>::flush(std::vector<Flush> &flushes,
+                                    bool header) {
+  for (const Flush &item : flushes) {
+    item.segment->sync(item.from, item.to, header);
+  }
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::insert(stored_type &&value) {
+  std::vector<Flush> flushes;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    if (closed()) {
+      return false;
+    }
+    size_t spilled = _spilled.load(std::memory_order_relaxed);
+    if (spilled == 0 && _memory.size() < _high_water) {
+      _memory.push_back(std::move(value));
+    } else {
+      open_segment()->append(std::addressof(ref(value)));
+      _spilled.store(spilled + 1, std::memory_order_relaxed);
+      _unsynced += sizeof(T);
+      if (_unsynced >= _sync_bytes) {
+        collect(flushes, false);
+      }
+    }
+    _count.store(_count.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+  }
+  _cv.notify_one();
+  // 定期写回只是尽力而为，失败时元素仍在页缓存里照常交付，sync()会报告错误
+  try {
+    flush(flushes, false);
+  } catch (const std::system_error &) {
+  }
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::push(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::push(T &&value) {
+  return emplace(std::move(value));
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::push_try(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::push_try(T &&value) {
+  return emplace(std::move(value));
+}
+
+// 元素在加锁之前构造；需要溢出时从中复制字节
+template <typename T, template <typename> class SmartPtr>
+template <class... Args>
+bool SpillQueue<T, SmartPtr>::emplace(Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    return insert(T(std::forward<Args>(args)...));
+  } else {
+    return insert(
+        detail::make_smart<T, SmartPtr>(std::forward<Args>(args)...));
+  }
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class... Args>
+bool SpillQueue<T, SmartPtr>::try_emplace(Args &&...args) {
+  return emplace(std::forward<Args>(args)...);
+}
+
+// 持锁调用，有元素时取出一个：内存中的元素总是比段文件里的早，
+// 从段文件读出的字节写入disk
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::take_locked(std::optional<stored_type> &memory,
+                                          void *disk) {
+  if (!_memory.empty()) {
+    memory.emplace(std::move(_memory.front()));
+    _memory.pop_front();
+  } else if (_spilled.load(std::memory_order_relaxed) != 0) {
+    _segments.front()->consume(disk);
+    _spilled.store(_spilled.load(std::memory_order_relaxed) - 1,
+                   std::memory_order_relaxed);
+    drop_drained();
+  } else {
+    return false;
+  }
+  _count.store(_count.load(std::memory_order_relaxed) - 1,
+               std::memory_order_relaxed);
+  return true;
+}
+
+// timeout_time为空表示不限时；从段文件读出的元素在释放锁之后才分配
+template <typename T, template <typename> class SmartPtr>
+template <class Clock, class Duration>
+SmartPtr<T> SpillQueue<T, SmartPtr>::take_until(
+    const std::chrono::time_point<Clock, Duration> *timeout_time) {
+  std::optional<stored_type> memory;
+  alignas(T) unsigned char disk[sizeof(T)];
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    auto ready = [&]() {
+      return closed() || !_memory.empty() ||
+             _spilled.load(std::memory_order_relaxed) != 0;
+    };
+    if (timeout_time == nullptr) {
+      _cv.wait(lock, ready);
+    } else if (!_cv.wait_until(lock, *timeout_time, ready)) {
+      return {};
+    }
+    if (!take_locked(memory, disk)) {
+      return {};
+    }
+  }
+  if (memory) {
+    return wrap(std::move(*memory));
+  }
+  return detail::make_smart<T, SmartPtr>(*reinterpret_cast<T *>(disk));
+}
+
+template <typename T, template <typename> class SmartPtr>
+SmartPtr<T> SpillQueue<T, SmartPtr>::pop_must() {
+  return take_until<std::chrono::steady_clock,
+                    std::chrono::steady_clock::duration>(nullptr);
+}
+
+template <typename T, template <typename> class SmartPtr>
+SmartPtr<T> SpillQueue<T, SmartPtr>::pop_try() {
+  auto now = std::chrono::steady_clock::now();
+  return take_until(&now);
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class Rep, class Period>
+SmartPtr<T> SpillQueue<T, SmartPtr>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class Clock, class Duration>
+SmartPtr<T> SpillQueue<T, SmartPtr>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return take_until(&timeout_time);
+}
+
+template <typename T, template <typename> class SmartPtr>
+void SpillQueue<T, SmartPtr>::close() {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    _closed.store(true, std::memory_order_relaxed);
+  }
+  _cv.notify_all();
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::closed() const {
+  return _closed.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr>
+template <class OutputIt>
+size_t SpillQueue<T, SmartPtr>::drain_into(OutputIt out) {
+  size_t count = 0;
+  // 与Queue一致：Inline模式写入T本身
+  while (SmartPtr<T> value = pop_try()) {
+    if constexpr (detail::is_inline_v<T, SmartPtr>) {
+      *out = std::move(*value);
+    } else {
+      *out = std::move(value);
+    }
+    ++out;
+    ++count;
+  }
+  return count;
+}
+
+template <typename T, template <typename> class SmartPtr>
+void SpillQueue<T, SmartPtr>::sync() {
+  std::vector<Flush> flushes;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    collect(flushes, true);
+  }
+  flush(flushes, true);
+}
+
+template <typename T, template <typename> class SmartPtr>
+size_t SpillQueue<T, SmartPtr>::size() const {
+  std::lock_guard<std::mutex> lock(_lock);
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr>
+size_t SpillQueue<T, SmartPtr>::size_approx() const {
+  return _count.load(std::memory_order_relaxed);
+}
+
+template <typename T, template <typename> class SmartPtr>
+bool SpillQueue<T, SmartPtr>::empty_approx() const {
+  return size_approx() == 0;
+}
+
+template <typename T, template <typename> class SmartPtr>
+size_t SpillQueue<T, SmartPtr>::spilled_approx() const {
+  return _spilled.load(std::memory_order_relaxed);
+}
+}; // namespace ThreadSafe
+
+#endif
@@ -0,0 +1,346 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace ThreadSafe {
+
+// 单生产者单消费者的定长环形缓冲区。head/tail分别在独立的缓存行上，
+// 每一方缓存对方的下标，只有看起来满/空时才重新读取对方的原子变量。
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait = Block>
+class alignas(detail::cache_line) SpscQueue {
+  static_assert(detail::is_storage_v<T, SmartPtr>,
+                "SmartPtr must be std::unique_ptr, std::shared_ptr, "
+                "PoolUnique, PoolShared or Inline");
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+public:
+  SpscQueue();
+
+  // close()之后所有push都返回false
+  bool push(const T &value);
+  bool push(T &&value);
+  bool push_try(const T &value);
+  bool push_try(T &&value);
+
+  template <class Rep, class Period>
+  bool push_for(const T &value,
+                const std::chrono::duration<Rep, Period> &timeout);
+  template <class Rep, class Period>
+  bool push_for(T &&value, const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  bool push_until(const T &value,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+  template <class Clock, class Duration>
+  bool push_until(T &&value,
+                  const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  template <class... Args> bool emplace(Args &&...args);
+  template <class... Args> bool try_emplace(Args &&...args);
+
+  SmartPtr<T> pop_must();
+  SmartPtr<T> pop_try();
+
+  template <class Rep, class Period>
+  SmartPtr<T> pop_for(const std::chrono::duration<Rep, Period> &timeout);
+
+  template <class Clock, class Duration>
+  SmartPtr<T>
+  pop_until(const std::chrono::time_point<Clock, Duration> &timeout_time);
+
+  // close()可以由任意线程调用；drain_into只能由消费者调用
+  void close();
+  bool closed() const;
+  template <class OutputIt> size_t drain_into(OutputIt out);
+
+  // 两个下标各自读取，size()本身就是近似值；size_approx()与其相同，
+  // 便于和Queue互换
+  size_t size() const;
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+private:
+  template <class Clock, class Duration, class... Args>
+  bool
+  emplace_until(const std::chrono::time_point<Clock, Duration> &timeout_time,
+                Args &&...args);
+
+  template <class... Args> bool enqueue(Args &&...args);
+  bool dequeue(SmartPtr<T> &value);
+
+  std::unique_ptr<SmartPtr<T>[]> _slots;
+
+  alignas(detail::cache_line) std::atomic<size_t> _head{0};
+  size_t _cached_tail = 0;
+
+  alignas(detail::cache_line) std::atomic<size_t> _tail{0};
+  size_t _cached_head = 0;
+
+  alignas(detail::cache_line) std::atomic<bool> _closed{false};
+  detail::Parking<Wait> _not_empty;
+  alignas(detail::cache_line) detail::Parking<Wait> _not_full;
+};
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+SpscQueue<T, SmartPtr, Capacity, Wait>::SpscQueue()
+    : _slots(new SmartPtr<T>[Capacity]) {}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class... Args>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::enqueue(Args &&...args) {
+  size_t tail = _tail.load(std::memory_order_relaxed);
+  if (tail - _cached_head == Capacity) {
+    _cached_head = _head.load(std::memory_order_acquire);
+    if (tail - _cached_head == Capacity) {
+      return false;
+    }
+  }
+  SmartPtr<T> &slot = _slots[tail & (Capacity - 1)];
+  if constexpr (detail::is_inline_v<T, SmartPtr>) {
+    slot.emplace(std::forward<Args>(args)...);
+  } else {
+    slot = detail::make_smart<T, SmartPtr>(std::forward<Args>(args)...);
+  }
+  _tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::dequeue(SmartPtr<T> &value) {
+  size_t head = _head.load(std::memory_order_relaxed);
+  if (head == _cached_tail) {
+    _cached_tail = _tail.load(std::memory_order_acquire);
+    if (head == _cached_tail) {
+      return false;
+    }
+  }
+  SmartPtr<T> &slot = _slots[head & (Capacity - 1)];
+  value = std::move(slot);
+  slot.reset();
+  _head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+size_t SpscQueue<T, SmartPtr, Capacity, Wait>::size() const {
+  size_t head = _head.load(std::memory_order_relaxed);
+  size_t tail = _tail.load(std::memory_order_relaxed);
+  return tail > head ? tail - head : 0;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+size_t SpscQueue<T, SmartPtr, Capacity, Wait>::size_approx() const {
+  return size();
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::empty_approx() const {
+  return size() == 0;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push(const T &value) {
+  return emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push(T &&value) {
+  return emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push_try(const T &value) {
+  return try_emplace(value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push_try(T &&value) {
+  return try_emplace(std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Rep, class Period>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push_for(
+    const T &value, const std::chrono::duration<Rep, Period> &timeout) {
+  return emplace_until(std::chrono::steady_clock::now() + timeout, value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Rep, class Period>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push_for(
+    T &&value, const std::chrono::duration<Rep, Period> &timeout) {
+  return emplace_until(std::chrono::steady_clock::now() + timeout,
+                       std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push_until(
+    const T &value,
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return emplace_until(timeout_time, value);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::push_until(
+    T &&value, const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  return emplace_until(timeout_time, std::forward<T>(value));
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration, class... Args>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::emplace_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time,
+    Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  bool ok = false;
+  _not_full.wait_until(
+      [&]() {
+        ok = enqueue(std::forward<Args>(args)...);
+        return ok || closed();
+      },
+      timeout_time);
+  if (ok) {
+    _not_empty.notify_one();
+  }
+  return ok;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class... Args>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::emplace(Args &&...args) {
+  if (closed()) {
+    return false;
+  }
+  bool ok = false;
+  _not_full.wait([&]() {
+    ok = enqueue(std::forward<Args>(args)...);
+    return ok || closed();
+  });
+  if (ok) {
+    _not_empty.notify_one();
+  }
+  return ok;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class... Args>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::try_emplace(Args &&...args) {
+  if (closed() || !enqueue(std::forward<Args>(args)...)) {
+    return false;
+  }
+  _not_empty.notify_one();
+  return true;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+SmartPtr<T> SpscQueue<T, SmartPtr, Capacity, Wait>::pop_must() {
+  SmartPtr<T> value;
+  _not_empty.wait([&]() {
+    bool stop = closed();
+    return dequeue(value) || stop;
+  });
+  if (value) {
+    _not_full.notify_one();
+  }
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+SmartPtr<T> SpscQueue<T, SmartPtr, Capacity, Wait>::pop_try() {
+  SmartPtr<T> value;
+  if (dequeue(value)) {
+    _not_full.notify_one();
+  }
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Rep, class Period>
+SmartPtr<T> SpscQueue<T, SmartPtr, Capacity, Wait>::pop_for(
+    const std::chrono::duration<Rep, Period> &timeout) {
+  return pop_until(std::chrono::steady_clock::now() + timeout);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class Clock, class Duration>
+SmartPtr<T> SpscQueue<T, SmartPtr, Capacity, Wait>::pop_until(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) {
+  SmartPtr<T> value;
+  _not_empty.wait_until(
+      [&]() {
+        bool stop = closed();
+        return dequeue(value) || stop;
+      },
+      timeout_time);
+  if (value) {
+    _not_full.notify_one();
+  }
+  return value;
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+void SpscQueue<T, SmartPtr, Capacity, Wait>::close() {
+  _closed.store(true);
+  _not_empty.notify_all();
+  _not_full.notify_all();
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+bool SpscQueue<T, SmartPtr, Capacity, Wait>::closed() const {
+  return _closed.load(std::memory_order_acquire);
+}
+
+template <typename T, template <typename> class SmartPtr, size_t Capacity,
+          class Wait>
+template <class OutputIt>
+size_t SpscQueue<T, SmartPtr, Capacity, Wait>::drain_into(OutputIt out) {
+  size_t count = 0;
+  for (SmartPtr<T> value; dequeue(value); ++count) {
+    if constexpr (detail::is_inline_v<T, SmartPtr>) {
+      *out = std::move(*value);
+    } else {
+      *out = std::move(value);
+    }
+    ++out;
+  }
+  if (count != 0) {
+    _not_full.notify_one();
+  }
+  return count;
+}
+}; // namespace ThreadSafe
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace ThreadSafe {
+namespace detail {
+inline size_t log2_bucket(uint64_t value) {
+  return value == 0 ? 0 : highest_bit(value);
+}
+
+// 纳秒耗时的对数直方图，buckets[i]统计落在[2^i, 2^(i+1))的次数
+class LatencyHistogram {
+public:
+  void add(std::chrono::steady_clock::duration elapsed);
+
+  struct Snapshot {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+    uint64_t buckets[64] = {};
+  };
+  Snapshot snapshot() const;
+
+private:
+  std::atomic<uint64_t> _buckets[64] = {};
+  std::atomic<uint64_t> _total_ns{0};
+};
+
+inline void
+LatencyHistogram::add(std::chrono::steady_clock::duration elapsed) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+  uint64_t value = ns.count() > 0 ? static_cast<uint64_t>(ns.count()) : 0;
+  _buckets[log2_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+  _total_ns.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline auto LatencyHistogram::snapshot() const -> Snapshot {
+  Snapshot snapshot;
+  for (size_t i = 0; i < 64; ++i) {
+    snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.total_ns = _total_ns.load(std::memory_order_relaxed);
+  // 分位点取所在桶的上界
+  uint64_t *targets[] = {&snapshot.p50_ns, &snapshot.p99_ns,
+                         &snapshot.p999_ns};
+  uint64_t ranks[] = {snapshot.count / 2, snapshot.count * 99 / 100,
+                      snapshot.count * 999 / 1000};
+  for (size_t t = 0; t < 3; ++t) {
+    uint64_t seen = 0;
+    for (size_t i = 0; i < 64; ++i) {
+      seen += snapshot.buckets[i];
+      if (seen > ranks[t]) {
+        *targets[t] = i == 63 ? UINT64_MAX : (uint64_t(2) << i) - 1;
+        break;
+      }
+    }
+  }
+  return snapshot;
+}
+} // namespace detail
+
+// 统计策略：Queue的最后一个模板参数。
+// NoStats的钩子全部为空，编译后没有任何额外开销。
+struct NoStats {
+  static constexpr bool enabled = false;
+
+  struct Stamp {};
+  static Stamp now() { return {}; }
+
+  void enqueued(size_t) {}
+  void dequeued(size_t) {}
+  void resized(size_t) {}
+  void stamped(size_t) {}
+  void aged(size_t) {}
+  void contended() {}
+  void blocked(Stamp) {}
+};
+
+struct QueueStats {
+  uint64_t enqueued = 0;
+  uint64_t dequeued = 0;
+  uint64_t high_water = 0;
+  uint64_t contended = 0; // 加锁时try_lock失败的次数
+  detail::LatencyHistogram::Snapshot blocked;  // pop_must/pop_for的阻塞时间
+  detail::LatencyHistogram::Snapshot in_queue; // 元素从push到pop的时间
+};
+
+// 计数器按线程编号分片，每片独占缓存行；snapshot()只读原子变量，不加锁，
+// 可以在任意线程周期性调用。resized/stamped/aged由队列持锁调用。
+class Counters {
+public:
+  static constexpr bool enabled = true;
+
+  using Stamp = std::chrono::steady_clock::time_point;
+  static Stamp now() { return std::chrono::steady_clock::now(); }
+
+  void enqueued(size_t count);
+  void dequeued(size_t count);
+  void resized(size_t size);
+  void stamped(size_t count);
+  void aged(size_t count);
+  void contended();
+  void blocked(Stamp start);
+
+  QueueStats snapshot() const;
+
+private:
+  static constexpr size_t shard_count = 16;
+
+  struct alignas(detail::cache_line) Shard {
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<uint64_t> dequeued{0};
+    std::atomic<uint64_t> contended{0};
+  };
+
+  Shard &local();
+
+  Shard _shards[shard_count];
+  alignas(detail::cache_line) std::atomic<uint64_t> _high_water{0};
+  detail::LatencyHistogram _blocked;
+  detail::LatencyHistogram _in_queue;
+  // FIFO模式下的入队时间，受队列的锁保护。第i个入队的元素记在
+  // _stamps[i % stamp_capacity]，临界区里不分配内存；入队时前面已有
+  // stamp_capacity个元素的不记录，也不计入in_queue
+  static constexpr size_t stamp_capacity = 1024;
+
+  struct Stamped {
+    uint64_t seq = UINT64_MAX;
+    Stamp time;
+  };
+
+  Stamped _stamps[stamp_capacity];
+  uint64_t _stamp_tail = 0; // 已入队的元素个数
+  uint64_t _stamp_head = 0; // 已出队的元素个数
+};
+
+inline Counters::Shard &Counters::local() {
+  return _shards[detail::thread_index() % shard_count];
+}
+
+inline void Counters::enqueued(size_t count) {
+  local().enqueued.fetch_add(count, std::memory_order_relaxed);
+}
+
+inline void Counters::dequeued(size_t count) {
+  local().dequeued.fetch_add(count, std::memory_order_relaxed);
+}
+
+inline void Counters::resized(size_t size) {
+  if (size > _high_water.load(std::memory_order_relaxed)) {
+    _high_water.store(size, std::memory_order_relaxed);
+  }
+}
+
+inline void Counters::stamped(size_t count) {
+  Stamp stamp = now();
+  for (; count > 0; --count, ++_stamp_tail) {
+    if (_stamp_tail - _stamp_head < stamp_capacity) {
+      _stamps[_stamp_tail % stamp_capacity] = {_stamp_tail, stamp};
+    }
+  }
+}
+
+inline void Counters::aged(size_t count) {
+  Stamp stamp = now();
+  for (; count > 0 && _stamp_head < _stamp_tail; --count, ++_stamp_head) {
+    const Stamped &entry = _stamps[_stamp_head % stamp_capacity];
+    if (entry.seq == _stamp_head) {
+      _in_queue.add(stamp - entry.time);
+    }
+  }
+}
+
+inline void Counters::contended() {
+  local().contended.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void Counters::blocked(Stamp start) { _blocked.add(now() - start); }
+
+inline QueueStats Counters::snapshot() const {
+  QueueStats stats;
+  for (const Shard &shard : _shards) {
+    stats.enqueued += shard.enqueued.load(std::memory_order_relaxed);
+    stats.dequeued += shard.dequeued.load(std::memory_order_relaxed);
+    stats.contended += shard.contended.load(std::memory_order_relaxed);
+  }
+  stats.high_water = _high_water.load(std::memory_order_relaxed);
+  stats.blocked = _blocked.snapshot();
+  stats.in_queue = _in_queue.snapshot();
+  return stats;
+}
+}; // namespace ThreadSafe
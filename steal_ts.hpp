@@ -0,0 +1,179 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace ThreadSafe {
+
+// Chase-Lev工作窃取双端队列。拥有者在bottom端不加锁地LIFO push / pop，
+// 其它线程在top端用CAS窃取(FIFO)。元素分配在堆上，槽位只存指针，
+// 所以窃取方读取槽位和拥有者扩容互不干扰；换下的旧数组留到析构时释放，
+// 窃取方拿着旧数组读到的指针仍然有效。
+template <typename T> class WorkStealingQueue {
+public:
+  // capacity为初始容量，向上取整为2的幂，满了由拥有者加倍
+  explicit WorkStealingQueue(size_t capacity = 256);
+  ~WorkStealingQueue();
+
+  WorkStealingQueue(const WorkStealingQueue &) = delete;
+  WorkStealingQueue &operator=(const WorkStealingQueue &) = delete;
+
+  // 以下三个只能由拥有者调用
+  void push(const T &value);
+  void push(T &&value);
+  template <class... Args> void emplace(Args &&...args);
+  // 取最后放入的元素，空时返回nullptr
+  std::unique_ptr<T> pop();
+
+  // 任意线程调用，取最早放入的元素；空或与其它线程竞争失败时返回nullptr
+  std::unique_ptr<T> steal();
+
+  // 不加锁的近似值
+  size_t size_approx() const;
+  bool empty_approx() const;
+
+private:
+  struct Buffer {
+    explicit Buffer(size_t capacity);
+
+    T *get(int64_t index) const;
+    void put(int64_t index, T *value);
+
+    size_t mask;
+    std::unique_ptr<std::atomic<T *>[]> slots;
+  };
+
+  void link(T *value);
+  Buffer *grow(Buffer *buffer, int64_t top, int64_t bottom);
+
+  alignas(detail::cache_line) std::atomic<int64_t> _top{0};
+  alignas(detail::cache_line) std::atomic<int64_t> _bottom{0};
+  std::atomic<Buffer *> _buffer;
+  // 只有拥有者访问：当前数组和所有换下的旧数组
+  std::vector<std::unique_ptr<Buffer>> _buffers;
+};
+
+template <typename T>
+WorkStealingQueue<T>::Buffer::Buffer(size_t capacity)
+    : mask(capacity - 1), slots(new std::atomic<T *>[capacity]) {}
+
+template <typename T>
+T *WorkStealingQueue<T>::Buffer::get(int64_t index) const {
+  return slots[static_cast<size_t>(index) & mask].load(
+      std::memory_order_relaxed);
+}
+
+template <typename T>
+void WorkStealingQueue<T>::Buffer::put(int64_t index, T *value) {
+  slots[static_cast<size_t>(index) & mask].store(value,
+                                                 std::memory_order_relaxed);
+}
+
+template <typename T>
+WorkStealingQueue<T>::WorkStealingQueue(size_t capacity) {
+  size_t size = 2;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  _buffers.push_back(std::make_unique<Buffer>(size));
+  _buffer.store(_buffers.back().get(), std::memory_order_relaxed);
+}
+
+template <typename T> WorkStealingQueue<T>::~WorkStealingQueue() {
+  Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+  int64_t bottom = _bottom.load(std::memory_order_relaxed);
+  for (int64_t i = _top.load(std::memory_order_relaxed); i < bottom; ++i) {
+    delete buffer->get(i);
+  }
+}
+
+template <typename T> void WorkStealingQueue<T>::push(const T &value) {
+  emplace(value);
+}
+
+template <typename T> void WorkStealingQueue<T>::push(T &&value) {
+  emplace(std::move(value));
+}
+
+template <typename T>
+template <class... Args>
+void WorkStealingQueue<T>::emplace(Args &&...args) {
+  link(new T(std::forward<Args>(args)...));
+}
+
+template <typename T> void WorkStealingQueue<T>::link(T *value) {
+  int64_t bottom = _bottom.load(std::memory_order_relaxed);
+  int64_t top = _top.load(std::memory_order_acquire);
+  Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+  if (bottom - top > static_cast<int64_t>(buffer->mask)) {
+    buffer = grow(buffer, top, bottom);
+  }
+  buffer->put(bottom, value);
+  // release使窃取方看到bottom时也看到槽位和元素本身
+  _bottom.store(bottom + 1, std::memory_order_release);
+}
+
+template <typename T>
+auto WorkStealingQueue<T>::grow(Buffer *buffer, int64_t top, int64_t bottom)
+    -> Buffer * {
+  _buffers.push_back(std::make_unique<Buffer>((buffer->mask + 1) * 2));
+  Buffer *bigger = _buffers.back().get();
+  for (int64_t i = top; i < bottom; ++i) {
+    bigger->put(i, buffer->get(i));
+  }
+  _buffer.store(bigger, std::memory_order_release);
+  return bigger;
+}
+
+template <typename T> std::unique_ptr<T> WorkStealingQueue<T>::pop() {
+  int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+  Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+  // 先占住bottom再读top，与steal里先读top再读bottom构成Dekker式的互斥
+  _bottom.store(bottom, std::memory_order_seq_cst);
+  int64_t top = _top.load(std::memory_order_seq_cst);
+  if (top > bottom) {
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  T *value = buffer->get(bottom);
+  if (top == bottom) {
+    // 只剩最后一个元素，和窃取方抢top
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      value = nullptr;
+    }
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return std::unique_ptr<T>(value);
+}
+
+template <typename T> std::unique_ptr<T> WorkStealingQueue<T>::steal() {
+  int64_t top = _top.load(std::memory_order_seq_cst);
+  int64_t bottom = _bottom.load(std::memory_order_seq_cst);
+  if (top >= bottom) {
+    return nullptr;
+  }
+  Buffer *buffer = _buffer.load(std::memory_order_acquire);
+  T *value = buffer->get(top);
+  if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  return std::unique_ptr<T>(value);
+}
+
+template <typename T> size_t WorkStealingQueue<T>::size_approx() const {
+  int64_t bottom = _bottom.load(std::memory_order_relaxed);
+  int64_t top = _top.load(std::memory_order_relaxed);
+  return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+}
+
+template <typename T> bool WorkStealingQueue<T>::empty_approx() const {
+  return size_approx() == 0;
+}
+}; // namespace ThreadSafe
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+// 不依赖测试框架：失败时打印位置并abort，ctest按退出状态判定
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,    \
+                   #condition);                                                \
+      std::abort();                                                            \
+    }                                                                          \
+  } while (0)
+
+namespace check {
+using namespace std::chrono_literals;
+
+// 以下模板只用到各个队列共有的push / pop_try / pop_for / pop_until /
+// pop_must / close / size_approx / empty_approx，
+// full()另外用到有界队列的push_try / push_for
+
+// 按cache_line对齐且大小是它的整数倍：数组里相邻的实例不共享缓存行
+template <class Q> constexpr bool padded() {
+  return alignof(Q) == ThreadSafe::detail::cache_line &&
+         sizeof(Q) % ThreadSafe::detail::cache_line == 0;
+}
+
+// 单线程push的元素按顺序取出，取空后pop_try返回空值
+template <class Q> void fifo(Q &queue, int count) {
+  for (int i = 0; i < count; ++i) {
+    CHECK(queue.push(i));
+  }
+  for (int i = 0; i < count; ++i) {
+    auto value = queue.pop_try();
+    CHECK(value && *value == i);
+  }
+  CHECK(!queue.pop_try());
+}
+
+// close()之后push失败，已有的元素仍能取出，取空后pop_must立即返回空值
+template <class Q> void close(Q &queue) {
+  CHECK(!queue.closed());
+  CHECK(queue.push(1));
+  CHECK(queue.push(2));
+  queue.close();
+  CHECK(queue.closed());
+  CHECK(!queue.push(3));
+  auto first = queue.pop_must();
+  CHECK(first && *first == 1);
+  auto second = queue.pop_must();
+  CHECK(second && *second == 2);
+  CHECK(!queue.pop_must());
+  CHECK(!queue.pop_try());
+}
+
+// 阻塞在空队列上的pop_must被另一个线程的close()唤醒
+template <class Q> void close_wakes(Q &queue) {
+  std::thread consumer([&]() { CHECK(!queue.pop_must()); });
+  std::this_thread::sleep_for(20ms);
+  queue.close();
+  consumer.join();
+}
+
+// 单线程时size_approx() / empty_approx()是精确的
+template <class Q> void approx(Q &queue) {
+  CHECK(queue.empty_approx() && queue.size_approx() == 0);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(queue.push(i));
+  }
+  CHECK(!queue.empty_approx() && queue.size_approx() == 3);
+  while (queue.pop_try()) {
+  }
+  CHECK(queue.empty_approx() && queue.size_approx() == 0);
+}
+
+// 空队列上的pop_for / pop_until至少等到超时才返回空值
+template <class Q> void timeout(Q &queue) {
+  auto start = std::chrono::steady_clock::now();
+  CHECK(!queue.pop_for(20ms));
+  CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+  start = std::chrono::steady_clock::now();
+  CHECK(!queue.pop_until(start + 20ms));
+  CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+}
+
+// 另一个线程稍后push，阻塞的pop_for在超时之前拿到它
+template <class Q> void timeout_wakes(Q &queue) {
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(10ms);
+    CHECK(queue.push(7));
+  });
+  auto value = queue.pop_for(5s);
+  CHECK(value && *value == 7);
+  producer.join();
+}
+
+// 容量为capacity的有界队列：满时push_try失败、push_for等到超时，
+// 阻塞的push在另一个线程pop之后成功
+template <class Q> void full(Q &queue, int capacity) {
+  for (int i = 0; i < capacity; ++i) {
+    CHECK(queue.push_try(i));
+  }
+  CHECK(!queue.push_try(capacity));
+  auto start = std::chrono::steady_clock::now();
+  CHECK(!queue.push_for(capacity, 20ms));
+  CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+  std::thread consumer([&]() {
+    std::this_thread::sleep_for(10ms);
+    auto value = queue.pop_try();
+    CHECK(value && *value == 0);
+  });
+  CHECK(queue.push_for(capacity, 5s));
+  consumer.join();
+  for (int i = 1; i <= capacity; ++i) {
+    auto value = queue.pop_try();
+    CHECK(value && *value == i);
+  }
+  CHECK(!queue.pop_try());
+}
+} // namespace check
@@ -0,0 +1,198 @@
+// 多生产者多消费者的压力测试，CMake另外以-fsanitize=thread构建一份(stress_mpmc_tsan)。
+// 每个元素恰好取出一次；同一个消费者看到的、来自同一个生产者的元素保持入队顺序
+// ./stress_mpmc [count_per_producer]
+
+#include "check.hpp"
+
+#include "intrusive_ts.hpp"
+#include "queue_ts.hpp"
+#include "ring_ts.hpp"
+#include "segmented_ts.hpp"
+#include "sharded_ts.hpp"
+#include "spsc_ts.hpp"
+#include "steal_ts.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace ThreadSafe;
+
+namespace {
+long count = 20000;
+
+class Seen {
+public:
+  explicit Seen(size_t size) : _flags(new std::atomic<unsigned char>[size]) {
+    for (size_t i = 0; i < size; ++i) {
+      _flags[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void mark(long value) {
+    CHECK(_flags[value].fetch_add(1, std::memory_order_relaxed) == 0);
+  }
+
+private:
+  std::unique_ptr<std::atomic<unsigned char>[]> _flags;
+};
+
+// value = producer * count + index
+template <class Q> void mpmc(Q &queue, int producers, int consumers) {
+  Seen seen(producers * count);
+  std::atomic<long> received{0};
+  std::vector<std::thread> threads;
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&]() {
+      std::vector<long> last(producers, -1);
+      while (auto value = queue.pop_must()) {
+        long producer = *value / count;
+        long index = *value % count;
+        CHECK(index > last[producer]);
+        last[producer] = index;
+        seen.mark(*value);
+        received.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (int p = 0; p < producers; ++p) {
+    writers.emplace_back([&, p]() {
+      for (long i = 0; i < count; ++i) {
+        CHECK(queue.push(p * count + i));
+      }
+    });
+  }
+  for (std::thread &writer : writers) {
+    writer.join();
+  }
+  queue.close();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  CHECK(received.load() == producers * count);
+}
+
+void spsc() {
+  SpscQueue<long, Inline, 64> queue;
+  std::thread producer([&]() {
+    for (long i = 0; i < count; ++i) {
+      CHECK(queue.push(i));
+    }
+    queue.close();
+  });
+  long expected = 0;
+  while (auto value = queue.pop_must()) {
+    CHECK(*value == expected);
+    ++expected;
+  }
+  producer.join();
+  CHECK(expected == count);
+}
+
+struct Node {
+  long value = 0;
+  IntrusiveHook hook;
+};
+
+void intrusive_mpsc(int producers) {
+  IntrusiveQueue<Node, &Node::hook, Mpsc> queue;
+  std::vector<Node> nodes(producers * count);
+  Seen seen(producers * count);
+  long received = 0;
+  std::thread consumer([&]() {
+    std::vector<long> last(producers, -1);
+    while (Node *node = queue.pop_must()) {
+      ++received;
+      long producer = node->value / count;
+      CHECK(node->value % count > last[producer]);
+      last[producer] = node->value % count;
+      seen.mark(node->value);
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int p = 0; p < producers; ++p) {
+    writers.emplace_back([&, p]() {
+      for (long i = 0; i < count; ++i) {
+        Node &node = nodes[p * count + i];
+        node.value = p * count + i;
+        CHECK(queue.push(&node));
+      }
+    });
+  }
+  for (std::thread &writer : writers) {
+    writer.join();
+  }
+  queue.close();
+  consumer.join();
+  CHECK(received == producers * count);
+}
+
+void work_stealing(int thieves) {
+  WorkStealingQueue<long> queue(4);
+  Seen seen(count);
+  std::atomic<bool> done{false};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thieves; ++t) {
+    threads.emplace_back([&]() {
+      while (!done.load() || !queue.empty_approx()) {
+        if (std::unique_ptr<long> value = queue.steal()) {
+          seen.mark(*value);
+        }
+      }
+    });
+  }
+  for (long i = 0; i < count; ++i) {
+    queue.push(i);
+    if (i % 3 == 0) {
+      if (std::unique_ptr<long> value = queue.pop()) {
+        seen.mark(*value);
+      }
+    }
+  }
+  while (std::unique_ptr<long> value = queue.pop()) {
+    seen.mark(*value);
+  }
+  done.store(true);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  CHECK(!queue.pop() && !queue.steal());
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    count = std::atol(argv[1]);
+  }
+  {
+    RingQueue<long, Inline, 64> queue;
+    mpmc(queue, 4, 4);
+  }
+  {
+    RingQueue<long, std::unique_ptr, 8, Spin<64>> queue;
+    mpmc(queue, 2, 3);
+  }
+  {
+    SegmentedQueue<long, Inline, 16> queue;
+    mpmc(queue, 4, 4);
+  }
+  {
+    SegmentedQueue<long, std::shared_ptr, 256, SpinYield<8>> queue;
+    mpmc(queue, 3, 2);
+  }
+  {
+    ShardedQueue<long, Inline> queue(4);
+    mpmc(queue, 4, 4);
+  }
+  {
+    Queue<long, Inline> queue(64);
+    mpmc(queue, 4, 4);
+  }
+  spsc();
+  intrusive_mpsc(4);
+  work_stealing(3);
+  return 0;
+}
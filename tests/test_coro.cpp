@@ -0,0 +1,113 @@
+// 只在C++20下构建(见CMakeLists.txt)
+#include "check.hpp"
+
+#include "queue_ts.hpp"
+
+#include <coroutine>
+#include <memory>
+#include <vector>
+
+#ifndef THREAD_SAFE_COROUTINES
+#error "test_coro requires C++20 coroutines"
+#endif
+
+using namespace ThreadSafe;
+
+namespace {
+// 立即开始、结束时自行销毁的协程
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::abort(); }
+  };
+};
+
+// 把要恢复的协程记下来，由测试决定何时恢复
+struct Deferred {
+  std::vector<std::coroutine_handle<>> *pending;
+  void operator()(std::coroutine_handle<> handle) const {
+    pending->push_back(handle);
+  }
+};
+
+// 取到的值写入out，空值写入-1
+template <template <typename> class SmartPtr, class Executor>
+Task consume(Queue<int, SmartPtr> &queue, Executor executor, int &out) {
+  auto value = co_await queue.co_pop(executor);
+  out = value ? *value : -1;
+}
+
+void resume_all(std::vector<std::coroutine_handle<>> &pending) {
+  std::vector<std::coroutine_handle<>> handles;
+  handles.swap(pending);
+  for (std::coroutine_handle<> handle : handles) {
+    handle.resume();
+  }
+}
+
+// 挂起的协程按挂起的顺序拿到元素
+template <template <typename> class SmartPtr> void ordered() {
+  Queue<int, SmartPtr> queue;
+  int got[3] = {0, 0, 0};
+  for (int &out : got) {
+    consume(queue, InlineExecutor(), out);
+  }
+  CHECK(got[0] == 0 && got[1] == 0 && got[2] == 0);
+  for (int i = 1; i <= 3; ++i) {
+    CHECK(queue.push(i));
+  }
+  CHECK(got[0] == 1 && got[1] == 2 && got[2] == 3);
+  CHECK(queue.size() == 0);
+}
+
+// push在锁内把元素交给等待的协程：恢复之前别的消费者拿不到它，
+// 恢复通过executor进行，而不是在push的线程上
+template <template <typename> class SmartPtr> void hand_off() {
+  Queue<int, SmartPtr> queue;
+  std::vector<std::coroutine_handle<>> pending;
+  int got = 0;
+  consume(queue, Deferred{&pending}, got);
+  CHECK(pending.empty());
+  CHECK(queue.push(5));
+  CHECK(pending.size() == 1 && got == 0);
+  CHECK(!queue.pop_try() && queue.size() == 0);
+  CHECK(queue.push(6));
+  resume_all(pending);
+  CHECK(got == 5);
+  // 队列非空时不挂起，也不经过executor
+  int ready = 0;
+  consume(queue, Deferred{&pending}, ready);
+  CHECK(ready == 6 && pending.empty());
+}
+
+// close()以空值恢复全部等待的协程，之后的co_pop不挂起
+template <template <typename> class SmartPtr> void close() {
+  Queue<int, SmartPtr> queue;
+  std::vector<std::coroutine_handle<>> pending;
+  int first = 0;
+  int second = 0;
+  consume(queue, Deferred{&pending}, first);
+  consume(queue, Deferred{&pending}, second);
+  CHECK(pending.empty());
+  queue.close();
+  CHECK(pending.size() == 2);
+  resume_all(pending);
+  CHECK(first == -1 && second == -1);
+  int late = 0;
+  consume(queue, Deferred{&pending}, late);
+  CHECK(late == -1 && pending.empty());
+}
+} // namespace
+
+int main() {
+  ordered<std::unique_ptr>();
+  ordered<Inline>();
+  hand_off<std::unique_ptr>();
+  hand_off<Inline>();
+  close<std::shared_ptr>();
+  close<Inline>();
+  return 0;
+}
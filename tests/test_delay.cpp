@@ -0,0 +1,77 @@
+#include "check.hpp"
+
+#include "delay_ts.hpp"
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ThreadSafe;
+using namespace std::chrono_literals;
+
+int main() {
+  using clock = std::chrono::steady_clock;
+  // 按到期时间而不是push的顺序取出，未到期时不取出
+  {
+    DelayQueue<int, std::unique_ptr> queue;
+    auto start = clock::now();
+    CHECK(queue.push(3, 30ms));
+    CHECK(queue.push(1, 10ms));
+    CHECK(queue.push(2, start + 20ms));
+    CHECK(!queue.pop_try());
+    for (int expected = 1; expected <= 3; ++expected) {
+      auto value = queue.pop_must();
+      CHECK(value && *value == expected);
+      CHECK(clock::now() - start >= expected * 10ms);
+    }
+  }
+  // pop_for在元素到期之前超时
+  {
+    DelayQueue<int, Inline> queue;
+    CHECK(queue.push(1, 1h));
+    auto start = clock::now();
+    CHECK(!queue.pop_for(20ms));
+    CHECK(clock::now() - start >= 20ms);
+    CHECK(!queue.pop_until(clock::now() + 20ms));
+    CHECK(queue.size() == 1);
+  }
+  // 等待远处到期元素的消费者被更早到期的push唤醒
+  {
+    DelayQueue<int, Inline> queue;
+    CHECK(queue.push(8, 1h));
+    std::thread producer([&]() {
+      std::this_thread::sleep_for(5ms);
+      CHECK(queue.push(7, 5ms));
+    });
+    auto start = clock::now();
+    auto value = queue.pop_must();
+    CHECK(value && *value == 7 && clock::now() - start < 1s);
+    producer.join();
+  }
+  // close()之后push失败，未到期的元素仍然按时取出
+  {
+    DelayQueue<int, Inline> queue;
+    CHECK(queue.push(1, 10ms));
+    queue.close();
+    CHECK(queue.closed());
+    CHECK(!queue.push(2, 0ms));
+    auto value = queue.pop_must();
+    CHECK(value && *value == 1);
+    CHECK(!queue.pop_must());
+  }
+  {
+    DelayQueue<int, Inline> queue;
+    check::close_wakes(queue);
+  }
+  {
+    DelayQueue<std::string, std::shared_ptr> queue;
+    CHECK(queue.push("later", 1h));
+    CHECK(queue.push("now", 0ms));
+    std::vector<std::shared_ptr<std::string>> out;
+    CHECK(queue.drain_into(std::back_inserter(out)) == 2);
+    CHECK(queue.empty_approx());
+  }
+  return 0;
+}
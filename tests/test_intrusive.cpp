@@ -0,0 +1,75 @@
+#include "check.hpp"
+
+#include "intrusive_ts.hpp"
+
+#include <iterator>
+#include <thread>
+#include <vector>
+
+using namespace ThreadSafe;
+using namespace std::chrono_literals;
+
+namespace {
+struct Message {
+  int value = 0;
+  IntrusiveHook hook;
+};
+
+template <class Mode> void basics() {
+  using Q = IntrusiveQueue<Message, &Message::hook, Mode>;
+  std::vector<Message> messages(100);
+  {
+    Q queue;
+    for (int i = 0; i < 100; ++i) {
+      messages[i].value = i;
+      CHECK(queue.push(&messages[i]));
+    }
+    CHECK(queue.size_approx() == 100);
+    for (int i = 0; i < 100; ++i) {
+      CHECK(queue.pop_try() == &messages[i]);
+    }
+    CHECK(queue.pop_try() == nullptr);
+    // 弹出的元素可以再次放入
+    CHECK(queue.push_try(&messages[0]) && queue.push(&messages[1]));
+    queue.close();
+    CHECK(queue.closed());
+    CHECK(!queue.push(&messages[2]));
+    CHECK(queue.pop_must() == &messages[0]);
+    CHECK(queue.pop_must() == &messages[1]);
+    CHECK(queue.pop_must() == nullptr);
+  }
+  {
+    Q queue;
+    std::thread consumer([&]() { CHECK(queue.pop_must() == nullptr); });
+    std::this_thread::sleep_for(20ms);
+    queue.close();
+    consumer.join();
+  }
+  {
+    Q queue;
+    auto start = std::chrono::steady_clock::now();
+    CHECK(queue.pop_for(20ms) == nullptr);
+    CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+    std::thread producer([&]() {
+      std::this_thread::sleep_for(10ms);
+      CHECK(queue.push(&messages[5]));
+    });
+    CHECK(queue.pop_for(5s) == &messages[5]);
+    producer.join();
+    CHECK(queue.push(&messages[1]) && queue.push(&messages[2]));
+    std::vector<Message *> out;
+    CHECK(queue.drain_into(std::back_inserter(out)) == 2);
+    CHECK(out[0] == &messages[1] && out[1] == &messages[2]);
+  }
+}
+} // namespace
+
+int main() {
+  basics<Locked>();
+  basics<Mpsc>();
+  // 复制元素时不复制钩子
+  Message original;
+  Message copy = original;
+  copy = original;
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include "check.hpp"
+
+#include "lane_ts.hpp"
+
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace ThreadSafe;
+using namespace std::chrono_literals;
+
+int main() {
+  // 高优先级通道先取出，同一通道内FIFO
+  {
+    LaneQueue<int, std::unique_ptr, 4> queue;
+    CHECK(queue.lanes() == 4);
+    CHECK(!queue.push(0, 4));
+    CHECK(queue.push(10, 0) && queue.push(11, 0));
+    CHECK(queue.push(30, 3) && queue.push(31, 3));
+    CHECK(queue.push(20, 2));
+    CHECK(queue.size(3) == 2 && queue.size() == 5);
+    for (int expected : {30, 31, 20, 10, 11}) {
+      auto value = queue.pop_try();
+      CHECK(value && *value == expected);
+    }
+    CHECK(!queue.pop_try());
+  }
+  {
+    LaneQueue<int, Inline> queue;
+    CHECK(queue.push(1, 0) && queue.push(2, 7));
+    queue.close();
+    CHECK(!queue.push(3, 0));
+    CHECK(*queue.pop_must() == 2);
+    CHECK(*queue.pop_must() == 1);
+    CHECK(!queue.pop_must());
+  }
+  {
+    LaneQueue<int, Inline> queue;
+    check::close_wakes(queue);
+  }
+  {
+    LaneQueue<int, Inline, 64> queue;
+    auto start = std::chrono::steady_clock::now();
+    CHECK(!queue.pop_for(20ms));
+    CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+    std::thread producer([&]() {
+      std::this_thread::sleep_for(10ms);
+      CHECK(queue.push(5, 63));
+    });
+    auto value = queue.pop_for(5s);
+    CHECK(value && *value == 5);
+    producer.join();
+    CHECK(queue.push(1, 0) && queue.push(2, 63));
+    std::vector<int> out;
+    CHECK(queue.drain_into(std::back_inserter(out)) == 2);
+    CHECK(out[0] == 2 && out[1] == 1);
+  }
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include "check.hpp"
+
+#include "numa_ts.hpp"
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+using namespace ThreadSafe;
+
+int main() {
+  // 单节点机器上模拟两个节点：CPU 0属于节点1
+  NumaTopology topology({{}, {0}});
+  CHECK(topology.node_count() == 2);
+  CHECK(topology.node_of(0) == 1);
+  {
+    NumaQueue<int, std::unique_ptr> queue(1, 1, topology);
+    CHECK(queue.node_count() == 2);
+    check::fifo(queue, 100);
+    check::close(queue);
+  }
+  {
+    NumaQueue<int, Inline> queue(1, 1, topology);
+    check::close_wakes(queue);
+  }
+  {
+    NumaQueue<int, Inline> queue(1, 1, topology);
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+  {
+    NumaQueue<int, std::shared_ptr> queue;
+    CHECK(queue.push(1) && queue.push(2));
+    CHECK(queue.size() == 2);
+    std::vector<std::shared_ptr<int>> out;
+    CHECK(queue.drain_into(std::back_inserter(out)) == 2);
+    CHECK(queue.empty_approx());
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+#include "check.hpp"
+
+#include "policy_ts.hpp"
+
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+using namespace ThreadSafe;
+
+static_assert(std::is_same_v<BasicQueue<int, Inline, SingleProducer,
+                                        SingleConsumer, Bounded<1024>,
+                                        Spin<128>>,
+                             SpscQueue<int, Inline, 1024, Spin<128>>>);
+static_assert(std::is_same_v<BasicQueue<int, std::unique_ptr, MultiProducer,
+                                        SingleConsumer, Bounded<64>>,
+                             RingQueue<int, std::unique_ptr, 64, Block>>);
+static_assert(std::is_same_v<BasicQueue<int>,
+                             SegmentedQueue<int, std::unique_ptr, 256, Block>>);
+static_assert(std::is_same_v<BasicQueue<int, Inline, MultiProducer,
+                                        MultiConsumer, Unbounded, Block,
+                                        Counters>,
+                             Queue<int, Inline, void, Block, Counters>>);
+
+int main() {
+  BasicQueue<int, Inline, SingleProducer, SingleConsumer, Bounded<8>,
+             Spin<128>>
+      spsc;
+  std::thread producer([&]() {
+    for (int i = 0; i < 10000; ++i) {
+      CHECK(spsc.push(i));
+    }
+    spsc.close();
+  });
+  int count = 0;
+  while (auto value = spsc.pop_must()) {
+    CHECK(*value == count);
+    ++count;
+  }
+  producer.join();
+  CHECK(count == 10000);
+
+  BasicQueue<int, std::shared_ptr, MultiProducer, MultiConsumer, Bounded<4>,
+             Block, Counters>
+      bounded;
+  CHECK(bounded.capacity() == 4);
+  check::full(bounded, 4);
+  return 0;
+}
@@ -0,0 +1,291 @@
+#include "check.hpp"
+
+#include "queue_ts.hpp"
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef THREAD_SAFE_EVENTFD
+#include <poll.h>
+#endif
+
+using namespace ThreadSafe;
+using namespace std::chrono_literals;
+
+static_assert(check::padded<Queue<int, std::unique_ptr>>(), "");
+
+namespace {
+// 记录复制和移动次数，检查emplace直接在最终存储里构造
+struct Counted {
+  static inline int copies = 0;
+  explicit Counted(int v) noexcept : value(v) {}
+  Counted(const Counted &other) : value(other.value) { ++copies; }
+  Counted(Counted &&other) noexcept : value(other.value) { ++copies; }
+  Counted &operator=(const Counted &other) {
+    value = other.value;
+    ++copies;
+    return *this;
+  }
+  int value;
+};
+
+template <template <typename> class SmartPtr, class Wait = Block>
+void basics() {
+  {
+    Queue<int, SmartPtr, void, Wait> queue;
+    check::fifo(queue, 100);
+    check::approx(queue);
+    check::close(queue);
+  }
+  {
+    Queue<int, SmartPtr, void, Wait> queue;
+    check::close_wakes(queue);
+  }
+  {
+    Queue<int, SmartPtr, void, Wait> queue;
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+}
+
+void bounded() {
+  Queue<int, Inline> queue(2);
+  CHECK(queue.capacity() == 2);
+  check::full(queue, 2);
+  CHECK(queue.push_try(1));
+  CHECK(queue.push_try(2));
+  CHECK(!queue.push_try(3));
+  auto start = std::chrono::steady_clock::now();
+  CHECK(!queue.push_until(3, start + 20ms));
+  CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+  // 满时阻塞的push被pop唤醒
+  std::thread consumer([&]() {
+    std::this_thread::sleep_for(10ms);
+    CHECK(*queue.pop_try() == 1);
+  });
+  CHECK(queue.push(3));
+  consumer.join();
+  // 等待空位的生产者被close()唤醒
+  std::thread closer([&]() {
+    std::this_thread::sleep_for(10ms);
+    queue.close();
+  });
+  CHECK(!queue.push(4));
+  closer.join();
+  CHECK(*queue.pop_try() == 2);
+  CHECK(*queue.pop_try() == 3);
+  // capacity为0时无界
+  Queue<int, Inline> unbounded;
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(unbounded.push_try(i));
+  }
+}
+
+void priority() {
+  Queue<int, std::unique_ptr, std::less<int>> queue;
+  std::vector<int> values = {5, 1, 4, 2, 3};
+  CHECK(queue.push_bulk(values.begin(), values.end()));
+  for (int expected = 5; expected >= 1; --expected) {
+    auto value = queue.pop_try();
+    CHECK(value && *value == expected);
+  }
+  CHECK(!queue.pop_try());
+  // 打乱的1000个元素逐个push，按Cmp的顺序取出
+  Queue<int, Inline, std::greater<int>> heap;
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(heap.push((i * 7919) % 1000));
+  }
+  for (int expected = 0; expected < 1000; ++expected) {
+    auto value = heap.pop_try();
+    CHECK(value && *value == expected);
+  }
+}
+
+void bulk() {
+  Queue<int, Inline> queue;
+  std::vector<int> values(10);
+  for (int i = 0; i < 10; ++i) {
+    values[i] = i;
+  }
+  CHECK(queue.push_bulk(values.begin(), values.end()));
+  std::vector<int> out;
+  CHECK(queue.pop_bulk(std::back_inserter(out), 4) == 4);
+  CHECK(out.front() == 0 && out.back() == 3);
+  auto rest = queue.pop_all();
+  CHECK(rest.size() == 6 && rest.front() == 4 && rest.back() == 9);
+  CHECK(queue.pop_bulk_for(std::back_inserter(out), 4, 20ms) == 0);
+  CHECK(queue.pop_all_for(20ms).empty());
+  // 阻塞的pop_all_for被push唤醒，一次取走全部
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(10ms);
+    CHECK(queue.push_bulk(values.begin(), values.end()));
+  });
+  CHECK(queue.pop_all_for(5s).size() == 10);
+  producer.join();
+  // drain_into在Inline模式下写入T
+  CHECK(queue.push(1) && queue.push(2));
+  std::vector<int> drained;
+  CHECK(queue.drain_into(std::back_inserter(drained)) == 2);
+  CHECK(drained[0] == 1 && drained[1] == 2);
+}
+
+void select_any() {
+  Queue<int, Inline> low;
+  Queue<int, Inline> high;
+  CHECK(low.push(1));
+  CHECK(high.push(2));
+  // 排在前面的队列优先
+  auto first = select(high, low);
+  CHECK(first && first.index == 0 && *first.value == 2);
+  auto second = select(high, low);
+  CHECK(second && second.index == 1 && *second.value == 1);
+  auto start = std::chrono::steady_clock::now();
+  CHECK(!pop_any_for(20ms, high, low));
+  CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(10ms);
+    CHECK(low.push(3));
+  });
+  auto woken = select(high, low);
+  CHECK(woken && woken.index == 1 && *woken.value == 3);
+  producer.join();
+  high.close();
+  low.close();
+  CHECK(!select(high, low));
+}
+
+template <template <typename> class SmartPtr> void emplace() {
+  Counted::copies = 0;
+  Queue<Counted, SmartPtr> queue;
+  CHECK(queue.emplace(1));
+  CHECK(queue.emplace(2));
+  CHECK(Counted::copies == 0);
+  auto value = queue.pop_try();
+  CHECK(value && value->value == 1);
+}
+
+// 锁外分配、解锁后通知：并发push的元素一个不少，阻塞的pop_must都被唤醒
+template <template <typename> class SmartPtr> void concurrent_push() {
+  Queue<int, SmartPtr> queue;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 4; ++p) {
+    producers.emplace_back([&, p]() {
+      for (int i = 0; i < 1000; ++i) {
+        CHECK(queue.push(p * 1000 + i));
+      }
+    });
+  }
+  std::vector<int> seen(4000);
+  for (int i = 0; i < 4000; ++i) {
+    auto value = queue.pop_must();
+    CHECK(value && ++seen[*value] == 1);
+  }
+  for (std::thread &producer : producers) {
+    producer.join();
+  }
+  CHECK(!queue.pop_try());
+}
+
+void producer_handle() {
+  Queue<int, Inline> queue;
+  {
+    auto handle = queue.producer(4, 0s);
+    for (int i = 0; i < 3; ++i) {
+      CHECK(handle.push(i));
+    }
+    CHECK(handle.buffered() == 3);
+    CHECK(!queue.pop_try());
+    CHECK(handle.push(3));
+    CHECK(handle.buffered() == 0);
+    CHECK(handle.push(4));
+  }
+  // 析构时发布剩下的元素，顺序不变
+  for (int i = 0; i < 5; ++i) {
+    auto value = queue.pop_try();
+    CHECK(value && *value == i);
+  }
+  // 缓冲区随句柄移走，被移走的句柄不再发布任何元素
+  auto from = queue.producer(4, 0s);
+  CHECK(from.push(5));
+  auto to = std::move(from);
+  CHECK(to.buffered() == 1 && from.buffered() == 0);
+  CHECK(!from.push(6) && !from.flush() && !from.poll());
+  CHECK(to.flush());
+  CHECK(*queue.pop_try() == 5 && !queue.pop_try());
+}
+
+void stats() {
+  Queue<int, Inline, void, Block, Counters> queue;
+  for (int i = 0; i < 2000; ++i) {
+    CHECK(queue.push(i));
+  }
+  for (int i = 0; i < 2000; ++i) {
+    CHECK(*queue.pop_try() == i);
+  }
+  CHECK(!queue.pop_for(1ms));
+  QueueStats snapshot = queue.stats().snapshot();
+  CHECK(snapshot.enqueued == 2000 && snapshot.dequeued == 2000);
+  CHECK(snapshot.high_water == 2000);
+  // 入队时前面已有1024个元素的不计入in_queue
+  CHECK(snapshot.in_queue.count == 1024);
+  CHECK(snapshot.blocked.count == 1);
+}
+
+#ifdef THREAD_SAFE_EVENTFD
+bool readable(int fd) {
+  pollfd entry{fd, POLLIN, 0};
+  return ::poll(&entry, 1, 0) == 1 && (entry.revents & POLLIN) != 0;
+}
+
+// fd可读当且仅当队列非空或已关闭
+void readiness() {
+  Queue<int, Inline> queue;
+  CHECK(queue.push(1));
+  // 创建时队列已经非空
+  int fd = queue.native_handle();
+  CHECK(fd >= 0 && queue.native_handle() == fd);
+  CHECK(readable(fd));
+  CHECK(queue.push(2));
+  CHECK(*queue.pop_try() == 1);
+  CHECK(readable(fd));
+  CHECK(queue.pop_all().size() == 1);
+  CHECK(!readable(fd));
+  CHECK(queue.push(3));
+  CHECK(readable(fd));
+  CHECK(*queue.pop_must() == 3);
+  CHECK(!readable(fd));
+  queue.close();
+  CHECK(readable(fd));
+}
+#endif
+} // namespace
+
+int main() {
+  basics<std::unique_ptr>();
+  basics<std::shared_ptr>();
+  basics<Inline>();
+  basics<PoolUnique>();
+  basics<PoolShared>();
+  // 自旋期间超时同样生效
+  basics<Inline, Spin<64>>();
+  basics<Inline, Adaptive<>>();
+  bounded();
+  priority();
+  bulk();
+  select_any();
+  emplace<std::unique_ptr>();
+  emplace<Inline>();
+  concurrent_push<std::unique_ptr>();
+  concurrent_push<Inline>();
+  // 生产者线程分配的块由消费者线程释放
+  concurrent_push<PoolUnique>();
+  producer_handle();
+  stats();
+#ifdef THREAD_SAFE_EVENTFD
+  readiness();
+#endif
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "check.hpp"
+
+#include "ring_ts.hpp"
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+using namespace ThreadSafe;
+
+static_assert(check::padded<RingQueue<int, std::unique_ptr, 128>>(), "");
+
+namespace {
+// 记录复制和移动次数，检查emplace直接在最终存储里构造
+struct Counted {
+  static inline int copies = 0;
+  explicit Counted(int v) noexcept : value(v) {}
+  Counted(const Counted &other) : value(other.value) { ++copies; }
+  Counted(Counted &&other) noexcept : value(other.value) { ++copies; }
+  Counted &operator=(const Counted &other) {
+    value = other.value;
+    ++copies;
+    return *this;
+  }
+  int value;
+};
+
+template <template <typename> class SmartPtr, class Wait> void basics() {
+  {
+    RingQueue<int, SmartPtr, 128, Wait> queue;
+    check::fifo(queue, 128);
+    check::approx(queue);
+    check::close(queue);
+  }
+  {
+    RingQueue<int, SmartPtr, 128, Wait> queue;
+    check::close_wakes(queue);
+  }
+  {
+    RingQueue<int, SmartPtr, 128, Wait> queue;
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+  {
+    RingQueue<int, SmartPtr, 8, Wait> queue;
+    check::full(queue, 8);
+  }
+}
+
+template <template <typename> class SmartPtr> void emplace() {
+  Counted::copies = 0;
+  RingQueue<Counted, SmartPtr, 2> queue;
+  CHECK(queue.emplace(1));
+  CHECK(queue.try_emplace(2));
+  CHECK(!queue.try_emplace(3));
+  CHECK(Counted::copies == 0);
+  auto value = queue.pop_try();
+  CHECK(value && value->value == 1);
+}
+} // namespace
+
+int main() {
+  basics<std::unique_ptr, Block>();
+  basics<std::shared_ptr, Block>();
+  basics<Inline, Block>();
+  basics<PoolUnique, Block>();
+  basics<PoolShared, Block>();
+  basics<Inline, Spin<64>>();
+  basics<Inline, BusyPoll>();
+  basics<std::shared_ptr, Adaptive<>>();
+  emplace<std::unique_ptr>();
+  emplace<Inline>();
+
+  // Queue的Ring<N>后端标签
+  Queue<int, Inline, Ring<64>> queue;
+  check::fifo(queue, 64);
+  CHECK(queue.push(1) && queue.push(2));
+  std::vector<int> out;
+  CHECK(queue.drain_into(std::back_inserter(out)) == 2);
+  CHECK(out[0] == 1 && out[1] == 2);
+  check::close(queue);
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include "check.hpp"
+
+#include "segmented_ts.hpp"
+
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace ThreadSafe;
+
+static_assert(check::padded<SegmentedQueue<int, std::unique_ptr>>(), "");
+
+namespace {
+template <template <typename> class SmartPtr, size_t BlockSize> void basics() {
+  {
+    // 跨越多个块
+    SegmentedQueue<int, SmartPtr, BlockSize> queue;
+    check::fifo(queue, 1000);
+    check::approx(queue);
+    check::close(queue);
+  }
+  {
+    SegmentedQueue<int, SmartPtr, BlockSize> queue;
+    check::close_wakes(queue);
+  }
+  {
+    SegmentedQueue<int, SmartPtr, BlockSize> queue;
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+}
+
+// 块很小时用完的块在并发的push / pop之间频繁回收
+void reclaim() {
+  SegmentedQueue<int, Inline, 4> queue;
+  const int count = 20000;
+  std::vector<std::atomic<int>> seen(2 * count);
+  std::atomic<int> received{0};
+  std::vector<std::thread> threads;
+  for (int p = 0; p < 2; ++p) {
+    threads.emplace_back([&, p]() {
+      for (int i = 0; i < count; ++i) {
+        CHECK(queue.push(p * count + i));
+      }
+    });
+  }
+  for (int c = 0; c < 2; ++c) {
+    threads.emplace_back([&]() {
+      while (received.load() < 2 * count) {
+        if (auto value = queue.pop_try()) {
+          CHECK(seen[*value].fetch_add(1) == 0);
+          received.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  CHECK(!queue.pop_try() && queue.empty_approx());
+}
+} // namespace
+
+int main() {
+  basics<std::unique_ptr, 2>();
+  basics<Inline, 16>();
+  basics<std::shared_ptr, 256>();
+  reclaim();
+
+  Queue<int, Inline, Segmented<8>> queue;
+  check::fifo(queue, 100);
+  CHECK(queue.push(1) && queue.push(2));
+  std::vector<int> out;
+  CHECK(queue.drain_into(std::back_inserter(out)) == 2);
+  CHECK(out[0] == 1 && out[1] == 2);
+  check::close(queue);
+  return 0;
+}
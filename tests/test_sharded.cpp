@@ -0,0 +1,78 @@
+#include "check.hpp"
+
+#include "sharded_ts.hpp"
+
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace ThreadSafe;
+
+static_assert(check::padded<ShardedQueue<int, Inline>>(), "");
+
+int main() {
+  // 同一个线程的元素都在它自己的分片里，保持FIFO
+  {
+    ShardedQueue<int, std::unique_ptr> queue(4);
+    CHECK(queue.shard_count() == 4);
+    check::fifo(queue, 100);
+    check::approx(queue);
+    check::close(queue);
+  }
+  {
+    ShardedQueue<int, Inline> queue(4);
+    check::close_wakes(queue);
+  }
+  {
+    ShardedQueue<int, std::shared_ptr> queue(4);
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+  {
+    // 其它线程写入的分片也能取到
+    ShardedQueue<int, std::unique_ptr> queue(3);
+    std::thread producer([&]() {
+      for (int i = 0; i < 10; ++i) {
+        CHECK(queue.push(i));
+      }
+    });
+    producer.join();
+    CHECK(queue.size() == 10);
+    for (int i = 0; i < 10; ++i) {
+      CHECK(queue.pop_try());
+    }
+    CHECK(!queue.pop_try() && queue.size() == 0);
+  }
+  {
+    // 只消费的线程从游标处扫描，每个生产者的分片都能取空
+    ShardedQueue<int, Inline> queue(4);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; ++p) {
+      producers.emplace_back([&, p]() {
+        for (int i = 0; i < 10; ++i) {
+          CHECK(queue.push(p * 10 + i));
+        }
+      });
+    }
+    for (std::thread &producer : producers) {
+      producer.join();
+    }
+    std::vector<int> seen(40);
+    for (int i = 0; i < 40; ++i) {
+      auto value = queue.pop_try();
+      CHECK(value && ++seen[*value] == 1);
+    }
+    CHECK(!queue.pop_try() && queue.empty_approx());
+  }
+  {
+    ShardedQueue<int, Inline> queue(3);
+    for (int i = 0; i < 10; ++i) {
+      CHECK(queue.push(i));
+    }
+    std::vector<int> out;
+    CHECK(queue.drain_into(std::back_inserter(out)) == 10);
+    CHECK(queue.empty_approx());
+  }
+  return 0;
+}
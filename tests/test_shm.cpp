@@ -0,0 +1,368 @@
+#include "check.hpp"
+
+#include "shm_ts.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ThreadSafe;
+using namespace std::chrono_literals;
+
+namespace {
+struct Message {
+  long producer;
+  long index;
+};
+
+std::string unique_name(const char *suffix) {
+  return "/thread_safe_test_" + std::to_string(::getpid()) + "_" + suffix;
+}
+
+void wait_child(pid_t child) {
+  int status = 0;
+  CHECK(::waitpid(child, &status, 0) == child);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void basics() {
+  using Q = ShmQueue<int, 128>;
+  std::string name = unique_name("basics");
+  {
+    Q queue(name, Q::Mode::create);
+    CHECK(queue.capacity() == 128);
+    check::fifo(queue, 128);
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+  {
+    // 容量不同的已有区域被拒绝
+    bool threw = false;
+    try {
+      ShmQueue<int, 64> other(name, ShmQueue<int, 64>::Mode::open);
+    } catch (const std::system_error &) {
+      threw = true;
+    }
+    CHECK(threw);
+    Q queue(name, Q::Mode::open);
+    check::full(queue, 128);
+    check::close(queue);
+  }
+  CHECK(Q::remove(name));
+  {
+    Q queue(name, Q::Mode::create);
+    check::close_wakes(queue);
+  }
+  CHECK(Q::remove(name));
+}
+
+// 生产者和消费者在不同的进程里，每个元素恰好取出一次
+void processes() {
+  using Q = ShmQueue<Message, 64>;
+  std::string name = unique_name("processes");
+  Q queue(name, Q::Mode::create);
+  const int producers = 3;
+  const long count = 5000;
+  std::vector<pid_t> children;
+  for (int p = 0; p < producers; ++p) {
+    pid_t child = ::fork();
+    if (child == 0) {
+      Q writer(name, Q::Mode::open);
+      for (long i = 0; i < count; ++i) {
+        if (!writer.push(Message{p, i})) {
+          ::_exit(1);
+        }
+      }
+      ::_exit(0);
+    }
+    children.push_back(child);
+  }
+  // 同一个生产者的元素按顺序到达
+  std::vector<long> next(producers, 0);
+  for (long received = 0; received < producers * count; ++received) {
+    auto value = queue.pop_for(10s);
+    CHECK(value && value->index == next[value->producer]);
+    ++next[value->producer];
+  }
+  for (pid_t child : children) {
+    wait_child(child);
+  }
+  CHECK(!queue.pop_try());
+  // close()唤醒另一个进程里阻塞的pop_must
+  pid_t child = ::fork();
+  if (child == 0) {
+    Q reader(name, Q::Mode::open);
+    ::_exit(reader.pop_must() ? 1 : 0);
+  }
+  std::this_thread::sleep_for(30ms);
+  queue.close();
+  wait_child(child);
+  CHECK(Q::remove(name));
+}
+
+// 区域开头的头部小于64KB，槽位0的数据跨过64KB处。把64KB之后设为只读
+// (写入时崩溃)或不可访问(读取时崩溃)：fork出的子进程在领取了下标、
+// 复制元素的途中死掉
+struct Big {
+  long index;
+  char payload[65536];
+};
+
+using BigQueue = ShmQueue<Big, 4>;
+
+void protect_slots(const std::string &name, int protection) {
+  FILE *maps = std::fopen("/proc/self/maps", "r");
+  CHECK(maps != nullptr);
+  char line[512];
+  uintptr_t begin = 0;
+  uintptr_t end = 0;
+  while (std::fgets(line, sizeof(line), maps) != nullptr) {
+    if (std::strstr(line, name.c_str() + 1) != nullptr) {
+      CHECK(std::sscanf(line, "%lx-%lx", &begin, &end) == 2);
+      break;
+    }
+  }
+  std::fclose(maps);
+  const uintptr_t offset = 65536;
+  CHECK(end > begin + offset);
+  CHECK(::mprotect(reinterpret_cast<void *>(begin + offset),
+                   end - begin - offset, protection) == 0);
+}
+
+void no_core_dump() {
+  rlimit none{0, 0};
+  ::setrlimit(RLIMIT_CORE, &none);
+}
+
+// 在子进程里执行f，要求它因SIGSEGV退出
+template <class F> void crash_in_child(const std::string &name, F f) {
+  pid_t child = ::fork();
+  if (child == 0) {
+    no_core_dump();
+    BigQueue queue(name, BigQueue::Mode::open);
+    f(queue);
+    ::_exit(0);
+  }
+  int status = 0;
+  CHECK(::waitpid(child, &status, 0) == child);
+  CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+}
+
+Big big(long index) {
+  Big value{};
+  value.index = index;
+  return value;
+}
+
+// 生产者领取了下标0之后死掉：消费者作废并跳过这个槽位，其余元素不丢失、
+// 不重复，槽位在下一轮照常使用
+void dead_producer() {
+  std::string name = unique_name("dead_producer");
+  auto queue = std::make_unique<BigQueue>(name, BigQueue::Mode::create);
+  crash_in_child(name, [&](BigQueue &writer) {
+    protect_slots(name, PROT_READ);
+    writer.push_try(big(0));
+  });
+  CHECK(queue->size_approx() == 1);
+  for (long i = 1; i < 4; ++i) {
+    CHECK(queue->push_try(big(i)));
+  }
+  for (long i = 1; i < 4; ++i) {
+    auto value = queue->pop_try();
+    CHECK(value && value->index == i);
+  }
+  CHECK(!queue->pop_try());
+  CHECK(queue->recovered() == 1);
+  for (long i = 4; i < 12; ++i) {
+    CHECK(queue->push(big(i)));
+    auto value = queue->pop_try();
+    CHECK(value && value->index == i);
+  }
+  queue.reset();
+  CHECK(BigQueue::remove(name));
+}
+
+// 消费者领取了下标0之后死掉：下一轮的生产者把槽位收回，
+// 只丢失它正在读取的那一个元素
+void dead_consumer() {
+  std::string name = unique_name("dead_consumer");
+  auto queue = std::make_unique<BigQueue>(name, BigQueue::Mode::create);
+  for (long i = 0; i < 4; ++i) {
+    CHECK(queue->push_try(big(i)));
+  }
+  crash_in_child(name, [&](BigQueue &reader) {
+    protect_slots(name, PROT_NONE);
+    reader.pop_try();
+  });
+  for (long i = 1; i < 4; ++i) {
+    auto value = queue->pop_try();
+    CHECK(value && value->index == i);
+  }
+  CHECK(queue->push_try(big(4)));
+  CHECK(queue->recovered() == 1);
+  auto value = queue->pop_try();
+  CHECK(value && value->index == 4 && !queue->pop_try());
+  queue.reset();
+  CHECK(BigQueue::remove(name));
+}
+
+// 多个消费者同时发现同一个死掉的生产者：只恢复一次，
+// 晚到的恢复方不会作废下一轮已经写入的元素
+void racing_recovery() {
+  std::string name = unique_name("racing_recovery");
+  auto queue = std::make_unique<BigQueue>(name, BigQueue::Mode::create);
+  for (int round = 0; round < 20; ++round) {
+    crash_in_child(name, [&](BigQueue &writer) {
+      protect_slots(name, PROT_READ);
+      // 每轮结束时下标都回到4的倍数，元素总是写在槽位0
+      writer.push_try(big(-1));
+    });
+    const long count = 64;
+    std::atomic<long> received{0};
+    std::vector<std::atomic<int>> seen(count);
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < 4; ++c) {
+      consumers.emplace_back([&]() {
+        while (received.load() < count) {
+          if (auto value = queue->pop_try()) {
+            CHECK(value->index >= 0 && value->index < count);
+            CHECK(seen[value->index].fetch_add(1) == 0);
+            received.fetch_add(1);
+          }
+        }
+      });
+    }
+    for (long i = 0; i < count; ++i) {
+      CHECK(queue->push_for(big(i), 10s));
+    }
+    for (std::thread &consumer : consumers) {
+      consumer.join();
+    }
+    CHECK(queue->recovered() == static_cast<size_t>(round + 1));
+    CHECK(!queue->pop_try());
+    // 作废的一个加上count个，下一轮从槽位0开始
+    for (long i = 0; i < 3; ++i) {
+      CHECK(queue->push_try(big(i)));
+      CHECK(queue->pop_try());
+    }
+  }
+  queue.reset();
+  CHECK(BigQueue::remove(name));
+}
+
+// 崩溃的生产者留下的记录被恢复方回收的同时，活着的进程在领取记录、
+// 登记下标：回收方不能改写已经被重新领取的记录，否则活着的生产者
+// 正在写入的槽位会被当成无人领取而作废
+void reap_race() {
+  std::string name = unique_name("reap_race");
+  auto queue = std::make_unique<BigQueue>(name, BigQueue::Mode::create);
+  auto *go = static_cast<std::atomic<int> *>(
+      ::mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  CHECK(go != MAP_FAILED);
+  new (go) std::atomic<int>(0);
+  const long producers = 3;
+  const long count = 200;
+  const int crashes = 16;
+  std::vector<pid_t> live;
+  std::vector<pid_t> crashing;
+  // 所有子进程在启动消费者线程之前fork
+  for (long p = 0; p < producers; ++p) {
+    pid_t child = ::fork();
+    if (child == 0) {
+      BigQueue writer(name, BigQueue::Mode::open);
+      while (go->load() == 0) {
+        std::this_thread::yield();
+      }
+      for (long i = 0; i < count; ++i) {
+        CHECK(writer.push_for(big(p * count + i), 10s));
+      }
+      ::_exit(0);
+    }
+    live.push_back(child);
+  }
+  for (int c = 0; c < crashes; ++c) {
+    pid_t child = ::fork();
+    if (child == 0) {
+      no_core_dump();
+      BigQueue writer(name, BigQueue::Mode::open);
+      while (go->load() == 0) {
+        std::this_thread::yield();
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(200 * c));
+      protect_slots(name, PROT_READ);
+      writer.push(big(-1));
+      ::_exit(0);
+    }
+    crashing.push_back(child);
+  }
+  std::vector<std::atomic<int>> seen(producers * count);
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < 4; ++c) {
+    consumers.emplace_back([&]() {
+      while (!stop.load()) {
+        if (auto value = queue->pop_for(1ms)) {
+          CHECK(value->index >= 0 && value->index < producers * count);
+          CHECK(seen[value->index].fetch_add(1) == 0);
+        }
+      }
+    });
+  }
+  go->store(1);
+  // 僵尸进程对kill(pid, 0)仍然存在，死掉的子进程要立即回收，
+  // 它领取的槽位才能被恢复
+  for (size_t i = 0; i < live.size() + crashing.size(); ++i) {
+    int status = 0;
+    pid_t child = ::waitpid(-1, &status, 0);
+    if (std::find(live.begin(), live.end(), child) != live.end()) {
+      CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    } else {
+      CHECK(std::find(crashing.begin(), crashing.end(), child) !=
+            crashing.end());
+      CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    }
+  }
+  stop.store(true);
+  for (std::thread &consumer : consumers) {
+    consumer.join();
+  }
+  // 最后崩溃的几个生产者领取的槽位在这里被跳过
+  CHECK(!queue->pop_try());
+  CHECK(queue->recovered() == static_cast<size_t>(crashes));
+  for (long i = 0; i < producers * count; ++i) {
+    CHECK(seen[i].load() == 1);
+  }
+  for (long i = 0; i < 8; ++i) {
+    CHECK(queue->push_try(big(i)));
+    auto value = queue->pop_try();
+    CHECK(value && value->index == i);
+  }
+  ::munmap(go, sizeof(std::atomic<int>));
+  queue.reset();
+  CHECK(BigQueue::remove(name));
+}
+} // namespace
+
+int main() {
+  basics();
+  processes();
+  dead_producer();
+  dead_consumer();
+  racing_recovery();
+  reap_race();
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include "check.hpp"
+
+#include "spill_ts.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace ThreadSafe;
+
+namespace {
+struct Message {
+  long producer;
+  long index;
+};
+
+size_t segment_files(const std::string &directory) {
+  size_t count = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+    count += entry.path().extension() == ".spill" ? 1 : 0;
+  }
+  return count;
+}
+
+void basics(const std::string &directory) {
+  {
+    SpillQueue<int, std::unique_ptr> queue(directory, 16, 4096);
+    check::fifo(queue, 1000);
+    check::close(queue);
+  }
+  {
+    SpillQueue<int, Inline> queue(directory, 16, 4096);
+    check::close_wakes(queue);
+  }
+  {
+    SpillQueue<int, Inline> queue(directory, 16, 4096);
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+}
+
+// 超过high_water的部分写入段文件，取完的段被删除
+void spill(const std::string &directory) {
+  SpillQueue<Message, Inline> queue(directory, 100, 4096, 1024);
+  for (long i = 0; i < 1000; ++i) {
+    CHECK(queue.push(Message{0, i}));
+  }
+  CHECK(queue.size() == 1000 && queue.spilled_approx() == 900);
+  CHECK(segment_files(directory) > 1);
+  for (long i = 0; i < 1000; ++i) {
+    auto value = queue.pop_try();
+    CHECK(value && value->index == i);
+  }
+  CHECK(!queue.pop_try());
+  CHECK(segment_files(directory) <= 1);
+  // drain_into在Inline模式下写入T，段文件里的也一起取出
+  for (long i = 0; i < 300; ++i) {
+    CHECK(queue.push(Message{0, i}));
+  }
+  std::vector<Message> drained;
+  CHECK(queue.drain_into(std::back_inserter(drained)) == 300);
+  CHECK(drained.front().index == 0 && drained.back().index == 299);
+  CHECK(queue.size() == 0);
+}
+
+// 段文件里的元素在重新打开同一个目录后按原来的顺序取出；
+// 内存里的元素随队列析构丢失
+void recovery(const std::string &directory) {
+  {
+    SpillQueue<Message, std::shared_ptr> queue(directory, 10, 4096);
+    for (long i = 0; i < 500; ++i) {
+      CHECK(queue.push(Message{0, i}));
+    }
+    // 内存里的10个加上段文件里的10个
+    for (long i = 0; i < 20; ++i) {
+      CHECK(queue.pop_try()->index == i);
+    }
+  }
+  {
+    SpillQueue<Message, std::shared_ptr> queue(directory, 10, 4096);
+    CHECK(queue.size() == 480);
+    CHECK(queue.push(Message{1, 0}));
+    for (long i = 20; i < 500; ++i) {
+      auto value = queue.pop_try();
+      CHECK(value && value->producer == 0 && value->index == i);
+    }
+    auto last = queue.pop_try();
+    CHECK(last && last->producer == 1);
+    queue.sync();
+  }
+  SpillQueue<Message, Inline> queue(directory, 10);
+  CHECK(queue.size() == 0);
+}
+
+// 掉电时中间段的标记没有全部写回：恢复后它没有写满，取完之后
+// 要继续读下一段，而不是读它标记之后的记录
+void torn_segment(const std::string &directory) {
+  {
+    SpillQueue<Message, Inline> queue(directory, 10, 4096);
+    for (long i = 0; i < 410; ++i) {
+      CHECK(queue.push(Message{0, i}));
+    }
+  }
+  std::vector<std::string> paths;
+  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+    paths.push_back(entry.path().string());
+  }
+  std::sort(paths.begin(), paths.end());
+  // 每段128条记录：4096 / (标记8 + Message16 + 对齐8)
+  CHECK(paths.size() == 4);
+  // 第二段第50条记录的标记清零：文件头64字节，每条记录24字节
+  int fd = ::open(paths[1].c_str(), O_WRONLY);
+  CHECK(fd >= 0);
+  uint64_t zero = 0;
+  CHECK(::pwrite(fd, &zero, sizeof(zero), 64 + 50 * 24) == sizeof(zero));
+  ::close(fd);
+  SpillQueue<Message, Inline> queue(directory, 10, 4096);
+  CHECK(queue.size() == 128 + 50 + 128 + 16);
+  std::vector<long> expected;
+  for (long i = 10; i < 188; ++i) {
+    expected.push_back(i);
+  }
+  for (long i = 266; i < 410; ++i) {
+    expected.push_back(i);
+  }
+  for (long index : expected) {
+    auto value = queue.pop_try();
+    CHECK(value && value->index == index);
+  }
+  CHECK(!queue.pop_try());
+  CHECK(queue.push(Message{1, 0}));
+  CHECK(queue.pop_try()->producer == 1);
+}
+} // namespace
+
+int main() {
+  char pattern[] = "/tmp/thread_safe_spill_XXXXXX";
+  CHECK(::mkdtemp(pattern) != nullptr);
+  std::string directory = pattern;
+  basics(directory);
+  spill(directory);
+  recovery(directory);
+  torn_segment(directory);
+  std::filesystem::remove_all(directory);
+  return 0;
+}
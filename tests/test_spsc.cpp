@@ -0,0 +1,61 @@
+#include "check.hpp"
+
+#include "spsc_ts.hpp"
+
+#include <memory>
+#include <thread>
+
+using namespace ThreadSafe;
+
+static_assert(check::padded<SpscQueue<int, std::unique_ptr, 64>>(), "");
+
+namespace {
+template <template <typename> class SmartPtr, class Wait> void basics() {
+  {
+    SpscQueue<int, SmartPtr, 64, Wait> queue;
+    check::fifo(queue, 64);
+    check::approx(queue);
+    check::close(queue);
+  }
+  {
+    SpscQueue<int, SmartPtr, 64, Wait> queue;
+    check::close_wakes(queue);
+  }
+  {
+    SpscQueue<int, SmartPtr, 64, Wait> queue;
+    check::timeout(queue);
+    check::timeout_wakes(queue);
+  }
+  {
+    SpscQueue<int, SmartPtr, 4, Wait> queue;
+    check::full(queue, 4);
+  }
+}
+
+// 一个生产者线程、一个消费者线程，满和空都会经过很多次，顺序不变
+template <template <typename> class SmartPtr, class Wait> void stream() {
+  SpscQueue<int, SmartPtr, 16, Wait> queue;
+  const int count = 100000;
+  std::thread producer([&]() {
+    for (int i = 0; i < count; ++i) {
+      CHECK(queue.push(i));
+    }
+  });
+  for (int i = 0; i < count; ++i) {
+    auto value = queue.pop_must();
+    CHECK(value && *value == i);
+  }
+  producer.join();
+  CHECK(!queue.pop_try());
+}
+} // namespace
+
+int main() {
+  basics<std::unique_ptr, Block>();
+  basics<Inline, Block>();
+  basics<Inline, SpinYield<16>>();
+  basics<Inline, BusyPoll>();
+  stream<Inline, Block>();
+  stream<Inline, Adaptive<>>();
+  return 0;
+}
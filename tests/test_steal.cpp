@@ -0,0 +1,32 @@
+#include "check.hpp"
+
+#include "steal_ts.hpp"
+
+#include <string>
+
+using namespace ThreadSafe;
+
+int main() {
+  // 拥有者从末尾取(LIFO)，窃取方从开头取(FIFO)
+  WorkStealingQueue<int> queue(2);
+  for (int i = 0; i < 10; ++i) {
+    queue.push(i);
+  }
+  CHECK(queue.size_approx() == 10);
+  CHECK(*queue.pop() == 9);
+  CHECK(*queue.steal() == 0);
+  CHECK(*queue.steal() == 1);
+  CHECK(*queue.pop() == 8);
+  for (int expected = 7; expected >= 2; --expected) {
+    CHECK(*queue.pop() == expected);
+  }
+  CHECK(!queue.pop() && !queue.steal());
+  CHECK(queue.empty_approx());
+
+  // 析构时释放剩下的元素
+  WorkStealingQueue<std::string> strings;
+  strings.emplace(3, 'x');
+  strings.push("left behind");
+  CHECK(*strings.steal() == "xxx");
+  return 0;
+}
@@ -0,0 +1,47 @@
+#include "check.hpp"
+
+#include "thread_pool_ts.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+using namespace ThreadSafe;
+using namespace std::chrono_literals;
+
+int main() {
+  // 析构时等待所有任务，包括任务执行期间提交到本地队列的任务
+  std::atomic<int> done{0};
+  {
+    ThreadPool pool(4);
+    CHECK(pool.size() == 4);
+    for (int i = 0; i < 200; ++i) {
+      pool.submit([&]() {
+        for (int j = 0; j < 10; ++j) {
+          pool.submit([&]() { done.fetch_add(1); });
+        }
+        done.fetch_add(1);
+      });
+    }
+  }
+  CHECK(done.load() == 200 * 11);
+  // 一个任务长时间执行时，其它线程在Parking上睡眠而不是空转；
+  // 它最后提交的任务在析构返回之前执行完
+  std::atomic<int> late{0};
+  std::clock_t cpu = std::clock();
+  {
+    ThreadPool pool(4);
+    pool.submit([&]() {
+      std::this_thread::sleep_for(200ms);
+      for (int i = 0; i < 8; ++i) {
+        pool.submit([&]() { late.fetch_add(1); });
+      }
+    });
+  }
+  CHECK(late.load() == 8);
+  CHECK(std::clock() - cpu < CLOCKS_PER_SEC / 10);
+  // 没有任务时直接退出
+  ThreadPool idle(2);
+  return 0;
+}
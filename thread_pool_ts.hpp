@@ -0,0 +1,158 @@
+#pragma once
+
+#include "queue_ts.hpp"
+#include "steal_ts.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ThreadSafe {
+
+// 每个工作线程一个WorkStealingQueue，任务里再提交的任务放进当前线程自己的队列；
+// 池外线程提交的任务进入全局的注入队列Queue。工作线程依次从自己的队列、
+// 注入队列、其它线程的队列取任务，都取不到时在Parking上睡眠。
+// 任务抛出的异常不会被捕获(std::terminate)
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+  // 等所有已提交的任务(包括执行期间新提交的)执行完再退出
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  template <class F> void submit(F &&task);
+
+  size_t size() const;
+
+private:
+  struct Worker {
+    WorkStealingQueue<Task> local;
+    std::thread thread;
+  };
+
+  struct Current {
+    ThreadPool *pool = nullptr;
+    size_t index = 0;
+  };
+  static Current &current();
+
+  void run(size_t index);
+  std::unique_ptr<Task> take(size_t index);
+  // 所有队列看起来都为空
+  bool idle() const;
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  Queue<Task, std::unique_ptr> _injection;
+  // 已提交还未执行完的任务数，析构时工作线程等它归0才退出
+  alignas(detail::cache_line) std::atomic<size_t> _pending{0};
+  std::atomic<bool> _stop{false};
+  detail::Parking<> _parking;
+};
+
+inline ThreadPool::ThreadPool(size_t threads) {
+  threads = threads == 0 ? 1 : threads;
+  for (size_t i = 0; i < threads; ++i) {
+    _workers.push_back(std::make_unique<Worker>());
+  }
+  // 所有本地队列就绪之后再启动线程，窃取时不会看到未构造的Worker
+  for (size_t i = 0; i < threads; ++i) {
+    _workers[i]->thread = std::thread([this, i]() { run(i); });
+  }
+}
+
+inline ThreadPool::~ThreadPool() {
+  _stop.store(true);
+  _parking.notify_all();
+  for (std::unique_ptr<Worker> &worker : _workers) {
+    worker->thread.join();
+  }
+}
+
+inline ThreadPool::Current &ThreadPool::current() {
+  thread_local Current current;
+  return current;
+}
+
+template <class F> void ThreadPool::submit(F &&task) {
+  // 先计数再放入，任务执行完时计数不会短暂地减到0以下
+  _pending.fetch_add(1);
+  Current &self = current();
+  if (self.pool == this) {
+    _workers[self.index]->local.emplace(std::forward<F>(task));
+  } else {
+    _injection.emplace(std::forward<F>(task));
+  }
+  _parking.notify_one();
+}
+
+inline size_t ThreadPool::size() const { return _workers.size(); }
+
+inline std::unique_ptr<ThreadPool::Task> ThreadPool::take(size_t index) {
+  if (std::unique_ptr<Task> task = _workers[index]->local.pop()) {
+    return task;
+  }
+  if (!_injection.empty_approx()) {
+    if (std::unique_ptr<Task> task = _injection.pop_try()) {
+      return task;
+    }
+  }
+  for (size_t i = 1; i < _workers.size(); ++i) {
+    Worker &victim = *_workers[(index + i) % _workers.size()];
+    if (victim.local.empty_approx()) {
+      continue;
+    }
+    if (std::unique_ptr<Task> task = victim.local.steal()) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+inline bool ThreadPool::idle() const {
+  if (!_injection.empty_approx()) {
+    return false;
+  }
+  for (const std::unique_ptr<Worker> &worker : _workers) {
+    if (!worker->local.empty_approx()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline void ThreadPool::run(size_t index) {
+  current() = Current{this, index};
+  for (;;) {
+    if (std::unique_ptr<Task> task = take(index)) {
+      (*task)();
+      // 析构期间最后一个任务执行完时唤醒睡眠的线程退出；
+      // 平时不唤醒，睡眠的线程只等submit
+      if (_pending.fetch_sub(1) == 1 && _stop.load()) {
+        _parking.notify_all();
+      }
+      continue;
+    }
+    // 有队列非空却没取到：窃取时竞争失败，再找一遍
+    if (!idle()) {
+      std::this_thread::yield();
+      continue;
+    }
+    // 所有队列都为空时睡眠，不管别的线程是否还在执行任务：
+    // 它们提交的任务由submit唤醒，执行完由上面的notify_all唤醒
+    _parking.wait([this]() {
+      return !idle() || (_stop.load() && _pending.load() == 0);
+    });
+    if (_stop.load() && _pending.load() == 0) {
+      return;
+    }
+  }
+}
+}; // namespace ThreadSafe
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace ThreadSafe {
+namespace detail {
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#else
+  std::this_thread::yield();
+#endif
+}
+} // namespace detail
+
+// 等待策略：pop_must/pop_for/pop_until在睡眠之前如何等待。
+// spin(probe, expired)反复调用无锁的probe，probe为true时返回true；
+// 返回false表示放弃自旋，调用方随后进入condition_variable等待。
+// parks为false的策略从不睡眠，通知方的唤醒代码在编译期去掉。
+
+// 直接阻塞
+struct Block {
+  static constexpr bool parks = true;
+
+  template <class Probe, class Expired> bool spin(Probe &&, Expired &&) {
+    return false;
+  }
+};
+
+// 自旋Spins次(每次之间pause)后阻塞
+template <size_t Spins> struct Spin {
+  static constexpr bool parks = true;
+
+  template <class Probe, class Expired>
+  bool spin(Probe &&probe, Expired &&expired);
+};
+
+// 自旋Spins次(每次之间让出CPU)后阻塞
+template <size_t Spins> struct SpinYield {
+  static constexpr bool parks = true;
+
+  template <class Probe, class Expired>
+  bool spin(Probe &&probe, Expired &&expired);
+};
+
+// 从不阻塞，一直轮询到成功或超时
+struct BusyPoll {
+  static constexpr bool parks = false;
+
+  template <class Probe, class Expired>
+  bool spin(Probe &&probe, Expired &&expired);
+};
+
+// 自旋预算随最近的命中情况调整：自旋期间等到了就加倍，没等到就减半
+template <size_t MaxSpins = 8192, size_t MinSpins = 16> struct Adaptive {
+  static_assert(MinSpins > 0 && MinSpins <= MaxSpins,
+                "MinSpins must be in (0, MaxSpins]");
+
+  static constexpr bool parks = true;
+
+  template <class Probe, class Expired>
+  bool spin(Probe &&probe, Expired &&expired);
+
+  size_t budget() const;
+
+private:
+  std::atomic<size_t> _budget{MinSpins};
+};
+
+namespace detail {
+// 没有声明parks的自定义策略按会睡眠处理
+template <class Wait, class = void> struct parks : std::true_type {};
+
+template <class Wait>
+struct parks<Wait, std::void_t<decltype(Wait::parks)>>
+    : std::bool_constant<Wait::parks> {};
+
+template <class Wait> inline constexpr bool parks_v = parks<Wait>::value;
+} // namespace detail
+
+template <size_t Spins>
+template <class Probe, class Expired>
+bool Spin<Spins>::spin(Probe &&probe, Expired &&expired) {
+  for (size_t i = 0; i < Spins; ++i) {
+    if (probe()) {
+      return true;
+    }
+    if ((i & 63) == 63 && expired()) {
+      return false;
+    }
+    detail::cpu_relax();
+  }
+  return probe();
+}
+
+template <size_t Spins>
+template <class Probe, class Expired>
+bool SpinYield<Spins>::spin(Probe &&probe, Expired &&expired) {
+  for (size_t i = 0; i < Spins; ++i) {
+    if (probe()) {
+      return true;
+    }
+    if (expired()) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return probe();
+}
+
+template <class Probe, class Expired>
+bool BusyPoll::spin(Probe &&probe, Expired &&expired) {
+  for (size_t i = 0;; ++i) {
+    if (probe()) {
+      return true;
+    }
+    if ((i & 63) == 63 && expired()) {
+      return false;
+    }
+    detail::cpu_relax();
+  }
+}
+
+template <size_t MaxSpins, size_t MinSpins>
+template <class Probe, class Expired>
+bool Adaptive<MaxSpins, MinSpins>::spin(Probe &&probe, Expired &&expired) {
+  size_t budget = _budget.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < budget; ++i) {
+    if (probe()) {
+      _budget.store(std::min(MaxSpins, budget * 2),
+                    std::memory_order_relaxed);
+      return true;
+    }
+    if ((i & 63) == 63 && expired()) {
+      return false;
+    }
+    detail::cpu_relax();
+  }
+  _budget.store(std::max(MinSpins, budget / 2), std::memory_order_relaxed);
+  return false;
+}
+
+template <size_t MaxSpins, size_t MinSpins>
+size_t Adaptive<MaxSpins, MinSpins>::budget() const {
+  return _budget.load(std::memory_order_relaxed);
+}
+}; // namespace ThreadSafe
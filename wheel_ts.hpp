@@ -0,0 +1,212 @@
+#pragma once
+
+#include "detail_ts.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ThreadSafe {
+namespace detail {
+
+// 分层时间轮：levels层，每层64个槽，每层一个64位的占用位图。
+// Node需要有Node *next和uint64_t tick(到期的刻度)两个成员，节点的所有权归调用方。
+// 到期刻度与当前刻度的最高不同位所在的6位组决定放在哪一层，所以插入是O(1)；
+// 下一次到期时间由各层位图的最低位直接算出，不扫描节点。
+// 当前刻度推进到某个高层槽的起点时，把该槽的节点重新插入到低层(级联)，
+// 到达第0层槽时节点进入ready链表。超出全部层数的节点放在far链表，
+// 刻度跨过2^(6*levels)的边界时才重新分配。
+template <class Node, size_t Levels = 6> class TimingWheel {
+  static_assert(Levels >= 1 && Levels * 6 < 64, "Levels must be in [1, 10]");
+
+public:
+  static constexpr uint64_t never = UINT64_MAX;
+
+  explicit TimingWheel(uint64_t now = 0) : _now(now) {}
+
+  TimingWheel(const TimingWheel &) = delete;
+  TimingWheel &operator=(const TimingWheel &) = delete;
+
+  uint64_t now() const { return _now; }
+
+  void insert(Node *node);
+  // 把当前刻度推进到now(只前进不后退)，途中到期的节点依次进入ready
+  void advance(uint64_t now);
+  // 下一个需要处理的刻度：有ready节点时为当前刻度，没有任何节点时为never
+  uint64_t next() const;
+
+  bool ready() const { return _ready_head != nullptr; }
+  Node *take();
+  // 取下全部节点(包括未到期的)，组成以next串起的链表
+  Node *release();
+
+private:
+  static constexpr size_t bits = 6;
+  static constexpr size_t slots = 64;
+  static constexpr uint64_t span = uint64_t(1) << (bits * Levels);
+
+  struct List {
+    Node *head = nullptr;
+    Node *tail = nullptr;
+
+    void append(Node *node);
+  };
+
+  static size_t slot_of(uint64_t tick, size_t level);
+  // 第level层第slot个槽在当前轮次中的起始刻度
+  uint64_t start_of(size_t level, size_t slot) const;
+  uint64_t next_event() const;
+  void expire(uint64_t tick);
+
+  uint64_t _now;
+  uint64_t _masks[Levels] = {};
+  List _wheel[Levels][slots];
+  List _far;
+  Node *_ready_head = nullptr;
+  Node *_ready_tail = nullptr;
+};
+
+template <class Node, size_t Levels>
+void TimingWheel<Node, Levels>::List::append(Node *node) {
+  node->next = nullptr;
+  if (tail == nullptr) {
+    head = node;
+  } else {
+    tail->next = node;
+  }
+  tail = node;
+}
+
+template <class Node, size_t Levels>
+size_t TimingWheel<Node, Levels>::slot_of(uint64_t tick, size_t level) {
+  return static_cast<size_t>(tick >> (bits * level)) & (slots - 1);
+}
+
+template <class Node, size_t Levels>
+uint64_t TimingWheel<Node, Levels>::start_of(size_t level, size_t slot) const {
+  uint64_t width = bits * (level + 1);
+  uint64_t upper = width < 64 ? _now >> width << width : 0;
+  return upper | static_cast<uint64_t>(slot) << (bits * level);
+}
+
+template <class Node, size_t Levels>
+void TimingWheel<Node, Levels>::insert(Node *node) {
+  if (node->tick <= _now) {
+    node->next = nullptr;
+    if (_ready_tail == nullptr) {
+      _ready_head = node;
+    } else {
+      _ready_tail->next = node;
+    }
+    _ready_tail = node;
+    return;
+  }
+  // 到期刻度的第level组6位一定大于当前刻度的，槽位总在当前位置之后
+  size_t level = highest_bit(node->tick ^ _now) / bits;
+  if (level >= Levels) {
+    _far.append(node);
+    return;
+  }
+  size_t slot = slot_of(node->tick, level);
+  _wheel[level][slot].append(node);
+  _masks[level] |= uint64_t(1) << slot;
+}
+
+template <class Node, size_t Levels>
+uint64_t TimingWheel<Node, Levels>::next_event() const {
+  uint64_t best = never;
+  for (size_t level = 0; level < Levels; ++level) {
+    if (_masks[level] != 0) {
+      uint64_t start = start_of(level, lowest_bit(_masks[level]));
+      best = start < best ? start : best;
+    }
+  }
+  if (best == never && _far.head != nullptr) {
+    // 下一次跨过全部层数覆盖的范围时重新分配far链表
+    best = (_now | (span - 1)) + 1;
+  }
+  return best;
+}
+
+template <class Node, size_t Levels>
+uint64_t TimingWheel<Node, Levels>::next() const {
+  return ready() ? _now : next_event();
+}
+
+// 当前刻度刚好到达tick：起点为tick的槽全部摘下重新插入
+template <class Node, size_t Levels>
+void TimingWheel<Node, Levels>::expire(uint64_t tick) {
+  if ((tick & (span - 1)) == 0 && _far.head != nullptr) {
+    Node *node = _far.head;
+    _far = List();
+    while (node != nullptr) {
+      Node *next = node->next;
+      insert(node);
+      node = next;
+    }
+  }
+  for (size_t level = Levels; level-- > 0;) {
+    size_t slot = slot_of(tick, level);
+    uint64_t bit = uint64_t(1) << slot;
+    if ((_masks[level] & bit) == 0 || start_of(level, slot) != tick) {
+      continue;
+    }
+    _masks[level] &= ~bit;
+    Node *node = _wheel[level][slot].head;
+    _wheel[level][slot] = List();
+    while (node != nullptr) {
+      Node *next = node->next;
+      insert(node);
+      node = next;
+    }
+  }
+}
+
+template <class Node, size_t Levels>
+void TimingWheel<Node, Levels>::advance(uint64_t now) {
+  for (;;) {
+    uint64_t event = next_event();
+    if (event > now) {
+      break;
+    }
+    _now = event;
+    expire(event);
+  }
+  _now = now > _now ? now : _now;
+}
+
+template <class Node, size_t Levels> Node *TimingWheel<Node, Levels>::take() {
+  Node *node = _ready_head;
+  if (node != nullptr) {
+    _ready_head = node->next;
+    if (_ready_head == nullptr) {
+      _ready_tail = nullptr;
+    }
+  }
+  return node;
+}
+
+template <class Node, size_t Levels>
+Node *TimingWheel<Node, Levels>::release() {
+  List all;
+  auto splice = [&](Node *node) {
+    while (node != nullptr) {
+      Node *next = node->next;
+      all.append(node);
+      node = next;
+    }
+  };
+  splice(_ready_head);
+  _ready_head = _ready_tail = nullptr;
+  for (size_t level = 0; level < Levels; ++level) {
+    for (size_t slot = 0; _masks[level] != 0 && slot < slots; ++slot) {
+      splice(_wheel[level][slot].head);
+      _wheel[level][slot] = List();
+    }
+    _masks[level] = 0;
+  }
+  splice(_far.head);
+  _far = List();
+  return all.head;
+}
+} // namespace detail
+}; // namespace ThreadSafe